@@ -0,0 +1,514 @@
+#define _POSIX_C_SOURCE 199309L
+#define _GNU_SOURCE // For M_PI
+#include "eng.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Engine microbenchmarks (headless)
+//
+//   ./bench [-o results.csv] [filter]
+//
+// Each case runs BENCH_SAMPLES timed samples; ns/op is reported as the
+// mean, the relative standard deviation and the fastest sample. -o also
+// writes one CSV line per case for comparing builds, and filter runs only
+// cases whose name contains it
+
+#define MIX_RATE 44100
+#define MIX_FRAMES (MIX_RATE * 5 / 1000) // one 5 ms period
+#define MIX_VOICES 64
+
+static f64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH_SAMPLES 15
+
+typedef void (*bench_fn)(void* arg, u32 ops);
+
+static FILE* bench_out;         // CSV results, NULL without -o
+static const char* bench_only;  // case name filter
+
+static u8 bench_want(const char* name)
+{
+    return !bench_only || strstr(name, bench_only);
+}
+
+// Report n samples of ops operations each
+static void bench_rec(const char* name, const f64* ns, u32 n, u32 ops)
+{
+    f64 sum = 0, min = 1e18;
+    for (u32 i = 0; i < n; i++) {
+        f64 t = ns[i] / ops;
+        sum += t;
+        if (t < min) min = t;
+    }
+    f64 mean = sum / n, var = 0;
+    for (u32 i = 0; i < n; i++) {
+        f64 d = ns[i] / ops - mean;
+        var += d * d;
+    }
+    f64 sd = n > 1 ? sqrt(var / (n - 1)) : 0;
+    
+    printf("  %-24s %12.1f ns/op  +-%5.1f%%  min %12.1f\n",
+           name, mean, mean > 0 ? 100 * sd / mean : 0, min);
+    if (bench_out) {
+        fprintf(bench_out, "%s,%.2f,%.2f,%.2f,%u,%u\n", name, mean, sd, min, n, ops);
+    }
+}
+
+// Time fn after one untimed warm-up call
+static void bench_case(const char* name, bench_fn fn, void* arg, u32 ops)
+{
+    f64 ns[BENCH_SAMPLES];
+    if (!bench_want(name)) return;
+    fn(arg, ops);
+    for (u32 i = 0; i < BENCH_SAMPLES; i++) {
+        f64 t0 = now_ns();
+        fn(arg, ops);
+        ns[i] = now_ns() - t0;
+    }
+    bench_rec(name, ns, BENCH_SAMPLES, ops);
+}
+
+// Keep results live without the compiler seeing through them
+static volatile uintptr_t bench_sink;
+
+// How many voices each mixing kernel fits into one 5 ms period
+static void bench_mix(void)
+{
+    static s16 src[MIX_VOICES][MIX_FRAMES];
+    static s32 l[MIX_FRAMES], r[MIX_FRAMES], rl[MIX_FRAMES], rr[MIX_FRAMES];
+    static s16 out[MIX_FRAMES * 2];
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    
+    srand(1);
+    for (u32 v = 0; v < MIX_VOICES; v++) {
+        for (u32 i = 0; i < MIX_FRAMES; i++) {
+            src[v][i] = (s16)(rand() & 0xFFFF);
+        }
+    }
+    
+    // Reference result
+    mix_fn ref = mix_get(MIX_SCALAR);
+    memset(rl, 0, sizeof(rl));
+    memset(rr, 0, sizeof(rr));
+    for (u32 v = 0; v < MIX_VOICES; v++) {
+        ref(rl, rr, src[v], MIX_FRAMES, 20000 + v, 12000 - v);
+    }
+    
+    // ns/op is per voice; 5e6 / ns/op voices fit in one period
+    printf("mix: %u frames per 5 ms period, ns per voice\n", MIX_FRAMES);
+    for (u8 k = MIX_SCALAR; k <= MIX_AVX2; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "mix/%s", names[k]);
+        if (!bench_want(name)) continue;
+        mix_fn fn = mix_get(k);
+        if (!fn) continue;
+        
+        // Several runs, each mixing every voice into one period
+        static f64 ns[200];
+        for (u32 run = 0; run < 200; run++) {
+            f64 t0 = now_ns();
+            memset(l, 0, sizeof(l));
+            memset(r, 0, sizeof(r));
+            for (u32 v = 0; v < MIX_VOICES; v++) {
+                fn(l, r, src[v], MIX_FRAMES, 20000 + v, 12000 - v);
+            }
+            mix_out(out, l, r, MIX_FRAMES);
+            ns[run] = now_ns() - t0;
+        }
+        
+        bench_rec(name, ns, 200, MIX_VOICES);
+        if (memcmp(l, rl, sizeof(l)) || memcmp(r, rr, sizeof(r))) {
+            fprintf(stderr, "%s differs from the scalar kernel\n", name);
+        }
+    }
+}
+
+// Synth throughput per waveform against a per-sample sin() loop
+static void bench_syn(void)
+{
+    static s16 buf[MIX_RATE];
+    const char* names[] = {"sin", "sqr", "saw", "tri", "noise"};
+    char name[32];
+    f64 ns[10];
+    
+    // ns/op is per sample; syn/libm is a per-sample sin() reference
+    printf("syn: 1 s of audio at %u Hz, ns per sample\n", MIX_RATE);
+    for (u32 run = 0; run < 10; run++) {
+        f64 t0 = now_ns();
+        for (u32 i = 0; i < MIX_RATE; i++) {
+            buf[i] = (s16)(3000 * sin(2 * M_PI * 440 * i / MIX_RATE));
+        }
+        ns[run] = now_ns() - t0;
+    }
+    if (bench_want("syn/libm")) bench_rec("syn/libm", ns, 10, MIX_RATE);
+    
+    for (u8 w = SYN_SIN; w <= SYN_NOISE; w++) {
+        snprintf(name, sizeof(name), "syn/%s", names[w - SYN_SIN]);
+        if (!bench_want(name)) continue;
+        syn p = {w, 440, 880, 0.5f, 0.01f, 0.1f, 0.7f, 0.1f};
+        for (u32 run = 0; run < 10; run++) {
+            syn_st st;
+            f64 t0 = now_ns();
+            syn_start(&st, &p, 1000, MIX_RATE);
+            syn_gen(&st, buf, MIX_RATE);
+            ns[run] = now_ns() - t0;
+        }
+        bench_rec(name, ns, 10, MIX_RATE);
+    }
+}
+
+// Particle-style update over a large array, serial against job_for
+#define JOB_ITEMS (1 << 20)
+
+static v2 job_pos[JOB_ITEMS], job_vel[JOB_ITEMS];
+
+static void job_step(void* arg, u32 beg, u32 end)
+{
+    (void)arg;
+    for (u32 i = beg; i < end; i++) {
+        job_vel[i].y += 0.1f;
+        job_pos[i].x += job_vel[i].x * 0.016f;
+        job_pos[i].y += job_vel[i].y * 0.016f;
+    }
+}
+
+static void job_case(void* arg, u32 ops)
+{
+    u32 grain = *(u32*)arg;
+    if (grain) {
+        job_for(job_step, NULL, ops, grain, NULL);
+    } else {
+        job_step(NULL, 0, ops);
+    }
+}
+
+static void bench_job(void)
+{
+    job_ini(0);
+    printf("job: %u items, %u workers\n", JOB_ITEMS, job_threads());
+    
+    u32 grains[] = {0, 256, 4096, 65536};
+    for (u32 g = 0; g < sizeof(grains) / sizeof(grains[0]); g++) {
+        char name[32];
+        if (grains[g]) snprintf(name, sizeof(name), "job/grain%u", grains[g]);
+        else snprintf(name, sizeof(name), "job/serial");
+        bench_case(name, job_case, &grains[g], JOB_ITEMS);
+    }
+    job_fin();
+}
+
+// Resource lookups by handle and by name with n resources registered
+#define RES_MAX 10000
+
+static u32 res_ids[RES_MAX];
+static char res_names[RES_MAX][16];
+
+static void res_get_case(void* arg, u32 ops)
+{
+    u32 n = *(u32*)arg;
+    uintptr_t x = 0;
+    for (u32 i = 0; i < ops; i++) {
+        x += (uintptr_t)res_get(res_ids[(i * 7919u) % n]);
+    }
+    bench_sink = x;
+}
+
+static void res_find_case(void* arg, u32 ops)
+{
+    u32 n = *(u32*)arg;
+    uintptr_t x = 0;
+    for (u32 i = 0; i < ops; i++) {
+        x += (uintptr_t)res_find(res_names[(i * 7919u) % n]);
+    }
+    bench_sink = x;
+}
+
+static void bench_res(void)
+{
+    u32 sizes[] = {10, 100, 1000, RES_MAX};
+    char name[32];
+    
+    printf("res: lookups\n");
+    for (u32 k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        u32 n = sizes[k];
+        for (u32 i = 0; i < n; i++) {
+            snprintf(res_names[i], sizeof(res_names[i]), "res_%u", i);
+            res_ids[i] = res_add(malloc(1), RES_SPR, res_names[i]);
+        }
+        snprintf(name, sizeof(name), "res_get/%u", n);
+        bench_case(name, res_get_case, &n, 100000);
+        snprintf(name, sizeof(name), "res_find/%u", n);
+        bench_case(name, res_find_case, &n, n < 1000 ? 100000 : 1000);
+        res_clear();
+    }
+}
+
+// Particle update and draw recording with n long-lived particles; one op
+// is one call over the whole set
+static void part_upd_case(void* arg, u32 ops)
+{
+    (void)arg;
+    for (u32 i = 0; i < ops; i++) part_upd();
+}
+
+static void part_drw_case(void* arg, u32 ops)
+{
+    (void)arg;
+    for (u32 i = 0; i < ops; i++) {
+        part_drw();
+        rnd_drop();
+    }
+}
+
+static void bench_part(void)
+{
+    u32 sizes[] = {1000, 10000, 100000};
+    char name[32];
+    
+    printf("part: one call over every particle\n");
+    srand(1);
+    for (u32 k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        part_clear();
+        for (u32 i = 0; i < sizes[k]; i++) {
+            v2 p = v2_mk(rand() % 800, rand() % 600);
+            v2 v = v2_mk((rand() % 200 - 100) / 100.0f, (rand() % 200 - 100) / 100.0f);
+            part_add(p, v, (col){255, 200, 100}, 1e6f, PART_DUST + i % 3);
+        }
+        snprintf(name, sizeof(name), "part_upd/%u", sizes[k]);
+        bench_case(name, part_upd_case, NULL, 20);
+        snprintf(name, sizeof(name), "part_drw/%u", sizes[k]);
+        bench_case(name, part_drw_case, NULL, 20);
+    }
+    part_clear();
+}
+
+// All-pairs collision over n sprites; one op is the whole n(n-1)/2 sweep
+#define SPR_MAX 1024
+
+static spr col_sprs[SPR_MAX];
+
+static void spr_col_case(void* arg, u32 ops)
+{
+    u32 n = *(u32*)arg;
+    u32 hits = 0;
+    for (u32 k = 0; k < ops; k++) {
+        for (u32 i = 0; i < n; i++) {
+            for (u32 j = i + 1; j < n; j++) {
+                hits += spr_col(col_sprs[i], col_sprs[j]);
+            }
+        }
+    }
+    bench_sink = hits;
+}
+
+static void bench_spr(void)
+{
+    u32 sizes[] = {64, 256, SPR_MAX};
+    char name[32];
+    
+    printf("spr: all-pairs collision\n");
+    srand(1);
+    for (u32 i = 0; i < SPR_MAX; i++) {
+        col_sprs[i] = spr_mk(v2_mk(rand() % 800, rand() % 600),
+                             v2_mk(8 + rand() % 32, 8 + rand() % 32),
+                             (col){255, 0, 0});
+    }
+    for (u32 k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        snprintf(name, sizeof(name), "spr_col/%u", sizes[k]);
+        bench_case(name, spr_col_case, &sizes[k], sizes[k] < SPR_MAX ? 20 : 2);
+    }
+}
+
+// Write a w x h 24-bit bottom-up BMP with non-black pixels, or, for a
+// glyph sheet, a random on/off pattern
+static u8 bmp_write(const char* path, u32 w, u32 h, u8 glyphs)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+    
+    u32 stride = (w * 3 + 3) & ~3u;
+    u32 size = 54 + stride * h;
+    u8 hdr[54] = {'B', 'M'};
+    u32 v[] = {size, 0, 54, 40, w, h};
+    memcpy(hdr + 2, v, sizeof(v));
+    hdr[26] = 1;    // planes
+    hdr[28] = 24;   // bits per pixel
+    fwrite(hdr, 1, sizeof(hdr), f);
+    
+    u8* row = calloc(1, stride);
+    if (!row) {
+        fclose(f);
+        return 0;
+    }
+    for (u32 y = 0; y < h; y++) {
+        for (u32 x = 0; x < w; x++) {
+            u8 c = glyphs ? (rand() & 1) * 255 : (u8)(x ^ y) | 1;
+            row[x * 3] = c;
+            row[x * 3 + 1] = glyphs ? c : (u8)y | 1;
+            row[x * 3 + 2] = glyphs ? c : (u8)x | 1;
+        }
+        fwrite(row, 1, stride, f);
+    }
+    free(row);
+    return fclose(f) == 0;
+}
+
+// Engine loaders log every file; keep that out of the results
+static int quiet_fd = -1;
+
+static void quiet(void)
+{
+    fflush(stdout);
+    quiet_fd = dup(1);
+    int nul = open("/dev/null", O_WRONLY);
+    if (nul >= 0) {
+        dup2(nul, 1);
+        close(nul);
+    }
+}
+
+static void loud(void)
+{
+    fflush(stdout);
+    if (quiet_fd >= 0) {
+        dup2(quiet_fd, 1);
+        close(quiet_fd);
+        quiet_fd = -1;
+    }
+}
+
+static void tex_load_case(void* arg, u32 ops)
+{
+    const char* path = arg;
+    for (u32 i = 0; i < ops; i++) {
+        u32 id = tex_load(path);
+        bench_sink = id;
+        tex_free(id);
+    }
+}
+
+typedef struct {
+    u32 id;
+    v2 sz;
+} tex_arg;
+
+static void tex_rec_case(void* arg, u32 ops)
+{
+    tex_arg* a = arg;
+    for (u32 i = 0; i < ops; i++) {
+        tex_drw(a->id, v2_mk(100, 100), a->sz);
+        if (i % 1024 == 1023) rnd_drop();
+    }
+    rnd_drop();
+}
+
+static void font_rec_case(void* arg, u32 ops)
+{
+    u32 id = *(u32*)arg;
+    const char* hud[] = {
+        "FPS: 60 Pos: (412.5, 300.0) Vel: (1.25, -3.50)",
+        "Resources: 12 (4096 KB)",
+        "Particles: 1500 (ON)",
+        "ESC: Menu",
+    };
+    for (u32 i = 0; i < ops; i++) {
+        font_drw(id, hud[i % 4], v2_mk(10, 20), (col){0, 0, 0}, i & 4 ? FONT_CENTER : FONT_LEFT);
+        if (i % 1024 == 1023) rnd_drop();
+    }
+    rnd_drop();
+}
+
+// Draw calls record commands here; rasterizing needs an X server, so the
+// tex_rec and font_rec cases time recording only and do not depend on scale
+static void bench_tex(void)
+{
+    char path[64], name[32];
+    u32 dims[] = {256, 1024, 4096};
+    
+    printf("tex: load (decode and free) and draw recording\n");
+    for (u32 k = 0; k < sizeof(dims) / sizeof(dims[0]); k++) {
+        snprintf(name, sizeof(name), "tex_load/%u", dims[k]);
+        if (!bench_want(name)) continue;
+        snprintf(path, sizeof(path), "/tmp/bench_%u_%u.bmp", (u32)getpid(), dims[k]);
+        if (!bmp_write(path, dims[k], dims[k], 0)) {
+            printf("  %-24s cannot write %s\n", name, path);
+            continue;
+        }
+        quiet();
+        f64 ns[BENCH_SAMPLES];
+        tex_load_case(path, 1);
+        for (u32 i = 0; i < BENCH_SAMPLES; i++) {
+            f64 t0 = now_ns();
+            tex_load_case(path, 1);
+            ns[i] = now_ns() - t0;
+        }
+        loud();
+        bench_rec(name, ns, BENCH_SAMPLES, 1);
+        remove(path);
+    }
+    
+    snprintf(path, sizeof(path), "/tmp/bench_%u_tex.bmp", (u32)getpid());
+    quiet();
+    u32 id = bmp_write(path, 64, 64, 0) ? tex_load(path) : 0;
+    loud();
+    remove(path);
+    if (id) {
+        f32 scales[] = {0.5f, 1, 4, 16};
+        for (u32 k = 0; k < sizeof(scales) / sizeof(scales[0]); k++) {
+            tex_arg a = {id, v2_mk(64 * scales[k], 64 * scales[k])};
+            snprintf(name, sizeof(name), "tex_rec/x%g", scales[k]);
+            bench_case(name, tex_rec_case, &a, 10000);
+        }
+        tex_free(id);
+    }
+    
+    // 16 x 6 glyph sheet of 8x8 cells starting at ' '
+    snprintf(path, sizeof(path), "/tmp/bench_%u_font.bmp", (u32)getpid());
+    srand(1);
+    quiet();
+    id = bmp_write(path, 128, 48, 1) ? font_load(path, 8, 8, 32) : 0;
+    loud();
+    remove(path);
+    if (id) {
+        bench_case("font_rec/hud", font_rec_case, &id, 10000);
+        font_free(id);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            bench_out = fopen(argv[++i], "w");
+            if (!bench_out) {
+                fprintf(stderr, "Cannot write %s\n", argv[i]);
+                return 1;
+            }
+            fprintf(bench_out, "name,ns_mean,ns_sd,ns_min,samples,ops\n");
+        } else {
+            bench_only = argv[i];
+        }
+    }
+    
+    bench_mix();
+    bench_syn();
+    bench_job();
+    bench_res();
+    bench_part();
+    bench_spr();
+    bench_tex();
+    
+    if (bench_out) fclose(bench_out);
+    return 0;
+}
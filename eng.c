@@ -10,7 +10,22 @@
 #include <X11/keysym.h>
 #include <sys/time.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 #include <alsa/asoundlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_SIMD 1 // SSSE3/AVX2 paths, selected at runtime
+#else
+#define X86_SIMD 0
+#endif
 
 // Engine state
 static eng_t e;
@@ -26,6 +41,35 @@ static void game_upd(void);
 static void game_drw(void);
 static void game_fin(void);
 
+static void stress_init(void);
+static void stress_upd(void);
+static void stress_drw(void);
+static void stress_fin(void);
+
+static void pause_init(void);
+static void pause_upd(void);
+static void pause_drw(void);
+static void pause_fin(void);
+
+static void scn_poll(void);
+#define SCN_FX_FRAMES 15 // length of a transition effect
+
+// Resource cache functions
+static char* str_dup(const char* str);
+static void res_account(u32 id);
+static s64 file_mtime(const char* path);
+static u32 res_cache_get(u8 type, const char* key, s64 mtime);
+static void res_cache_put(u32 id, const char* key, s64 mtime);
+static void res_uncache(res* r);
+
+// Async loader functions
+static void ld_ini(void);
+static void ld_poll(void);
+static void ld_fin(void);
+
+// Input recording mode, see inp_use
+static u8 inp_mode;
+
 // Particle functions
 static part part_mk(v2 pos, v2 vel, col clr, f32 life, u8 type);
 static part_emit part_emit_mk(v2 pos, v2 vel_range, f32 life_range, u8 type, u32 rate);
@@ -64,6 +108,142 @@ static u32 tm(void)
     return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
 }
 
+// Get monotonic time in nanoseconds
+static u64 tm_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+#ifdef PROF
+// Profiler: each thread records finished zones into its own ring, so
+// recording takes no locks; prof_dump writes Chrome trace_event JSON
+#define PROF_RING 16384 // zones kept per thread, power of two
+#define PROF_DEPTH 32   // nesting tracked per thread
+#define PROF_THREADS 32
+
+typedef struct {
+    const char* name;
+    u64 t0;         // ns
+    u32 dur;        // ns
+    u32 depth;
+} prof_ev;
+
+typedef struct {
+    const char* name;
+    u32 tid;
+    u32 w;          // zones written
+    u32 sp;         // open zones
+    const char* open[PROF_DEPTH];
+    u64 open_t0[PROF_DEPTH];
+    prof_ev ev[PROF_RING];
+} prof_thr;
+
+static prof_thr* prof_thrs[PROF_THREADS];
+static u32 prof_nthr;
+static __thread prof_thr* prof_me;
+
+static prof_thr* prof_get(void)
+{
+    if (prof_me) return prof_me;
+    
+    u32 i = __atomic_fetch_add(&prof_nthr, 1, __ATOMIC_ACQ_REL);
+    if (i >= PROF_THREADS) return NULL;
+    prof_thr* t = calloc(1, sizeof(prof_thr));
+    if (!t) return NULL;
+    t->tid = i + 1;
+    t->name = "thread";
+    __atomic_store_n(&prof_thrs[i], t, __ATOMIC_RELEASE);
+    prof_me = t;
+    return t;
+}
+
+// Name the calling thread in traces
+void prof_thread(const char* name)
+{
+    prof_thr* t = prof_get();
+    if (t) t->name = name;
+}
+
+void prof_beg(const char* name)
+{
+    prof_thr* t = prof_get();
+    if (!t) return;
+    if (t->sp < PROF_DEPTH) {
+        t->open[t->sp] = name;
+        t->open_t0[t->sp] = tm_ns();
+    }
+    t->sp++;
+}
+
+void prof_end(void)
+{
+    u64 now = tm_ns();
+    prof_thr* t = prof_me;
+    if (!t || !t->sp) return;
+    if (--t->sp >= PROF_DEPTH) return;
+    
+    prof_ev* ev = &t->ev[t->w & (PROF_RING - 1)];
+    ev->name = t->open[t->sp];
+    ev->t0 = t->open_t0[t->sp];
+    ev->dur = (u32)(now - ev->t0);
+    ev->depth = t->sp;
+    __atomic_store_n(&t->w, t->w + 1, __ATOMIC_RELEASE);
+}
+
+// Write the zones still in the rings as complete ("X") events. Threads
+// keep recording meanwhile, so their oldest zones may be overwritten
+u8 prof_dump(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to write trace: %s\n", path);
+        return 0;
+    }
+    
+    u32 nthr = __atomic_load_n(&prof_nthr, __ATOMIC_ACQUIRE);
+    if (nthr > PROF_THREADS) nthr = PROF_THREADS;
+    u32 total = 0;
+    
+    fprintf(f, "{\"traceEvents\":[\n");
+    const char* sep = "";
+    for (u32 i = 0; i < nthr; i++) {
+        prof_thr* t = __atomic_load_n(&prof_thrs[i], __ATOMIC_ACQUIRE);
+        if (!t) continue;
+        
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s\"}}", sep, t->tid, t->name);
+        sep = ",\n";
+        
+        u32 w = __atomic_load_n(&t->w, __ATOMIC_ACQUIRE);
+        u32 r = w > PROF_RING ? w - PROF_RING : 0;
+        for (; r < w; r++) {
+            const prof_ev* ev = &t->ev[r & (PROF_RING - 1)];
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f}", sep, ev->name, t->tid,
+                    ev->t0 / 1e3, ev->dur / 1e3);
+            total++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    
+    printf("Wrote trace: %s (%u zones)\n", path, total);
+    return 1;
+}
+
+static void prof_fin(void)
+{
+    for (u32 i = 0; i < PROF_THREADS; i++) {
+        free(prof_thrs[i]);
+        prof_thrs[i] = NULL;
+    }
+    prof_nthr = 0;
+    prof_me = NULL;
+}
+#endif
+
 // Convert X11 key to engine key code
 static u8 xk(KeySym ks)
 {
@@ -79,70 +259,505 @@ static u8 xk(KeySym ks)
         case XK_p: return KEY_P;
         case XK_b: return KEY_B;
         case XK_f: return KEY_F;
+        case XK_t: return KEY_T;
         default: return 0;
     }
 }
 
+// Render commands. Draw calls record into a command list and rnd_exec
+// rasterizes it, right after scn_drw or, when pipelined, on the render
+// thread while the next frame updates
+#define RC_CLEAR 0x01
+#define RC_RECT 0x02
+#define RC_TEX 0x03
+#define RC_FONT 0x04
+#define RC_STR 0x05
+#define RC_PARTS 0x06
+#define RC_BG 0x07
+
+typedef struct rcmd {
+    struct rcmd* next;
+    u8 op;
+    col clr;
+    s32 x, y, w, h;
+    const void* p;  // RC_TEX pixels, RC_FONT font, RC_PARTS snapshot
+    const char* s;  // RC_FONT, RC_STR text
+    u32 n;          // RC_TEX width, RC_STR length, RC_PARTS count, RC_BG version
+    u32 m;          // RC_TEX height
+} rcmd;
+
+// One frame of commands; the arena holds the commands and copied data
+typedef struct {
+    arena a;
+    rcmd* head;
+    rcmd* tail;
+    u32 n;          // commands recorded
+    u32 fc;         // frame it was recorded in
+} rlist;
+
+// Rasterizer state, one per X connection
+typedef struct {
+    Display* dpy;
+    GC gc;
+    arena scr;      // scratch, reset per frame
+    col fg;         // current foreground, valid when has_fg
+    u8 has_fg;
+    u32 xreq;       // X requests issued this frame
+    Pixmap bg;      // background layer, 0 until first baked
+    u32 bg_ver;     // bg_ver the layer was baked from
+} rctx;
+
+static rlist rnd_l[3];              // [0] only, unless pipelined
+static rlist* rnd_cur = &rnd_l[0];  // list being recorded
+static rctx rnd_main;               // main thread, e.dpy
+
+// Pipelined: triple buffer, the update thread writes rnd_w, the render
+// thread reads rnd_r, and rnd_ready holds the latest finished frame
+static u32 rnd_w, rnd_ready = 1, rnd_r = 2;
+static u8 rnd_new;                  // rnd_ready not drawn yet
+static u8 rnd_busy;                 // render thread drawing rnd_r
+static u8 rnd_quit;
+static pthread_t rnd_thr;
+static pthread_mutex_t rnd_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rnd_cv = PTHREAD_COND_INITIALIZER;
+static rctx rnd_thr_ctx;            // render thread's own connection
+static u32 rnd_xreq;                // X requests of the last rasterized frame
+static u32 rnd_drawn;               // frames rasterized
+
+// Static sprites for the background layer. The update thread snapshots
+// them when they change; rasterizers re-bake from the snapshot under
+// rnd_mtx when a frame asks for a newer version than they hold
+static spr* bg_spr;
+static u32 bg_n;
+static u32 bg_cap;
+static spr* bg_ext;     // layer content kept outside the sprite array
+static u32 bg_next;
+static u32 bg_ecap;
+static u32 bg_ver;
+static u8 bg_dirty = 1;
+
 // Set graphics context color
-static void set_col(col c)
+static void set_col(rctx* r, col c)
 {
+    // XAllocColor is a round trip; skip it when the color is unchanged
+    if (r->has_fg && r->fg.r == c.r && r->fg.g == c.g && r->fg.b == c.b) return;
+    r->fg = c;
+    r->has_fg = 1;
+    
     XColor xc;
-    Colormap cm = DefaultColormap(e.dpy, DefaultScreen(e.dpy));
+    Colormap cm = DefaultColormap(r->dpy, DefaultScreen(r->dpy));
     
     xc.red = c.r * 256;
     xc.green = c.g * 256;
     xc.blue = c.b * 256;
     xc.flags = DoRed | DoGreen | DoBlue;
     
-    XAllocColor(e.dpy, cm, &xc);
-    XSetForeground(e.dpy, e.gc, xc.pixel);
+    XAllocColor(r->dpy, cm, &xc);
+    XSetForeground(r->dpy, r->gc, xc.pixel);
+    r->xreq += 2;
 }
 
-// Generate sine wave audio sample
-static snd gen_sin(u32 hz, u32 ms, u32 rate)
+// Append a zeroed command to the list being recorded
+static rcmd* rnd_add(u8 op)
 {
-    snd s;
-    s.rate = rate;
-    s.ch = 1;
-    s.len = (rate * ms) / 1000;
-    s.data = malloc(s.len * sizeof(s16));
-    s.id = 0;
+    rcmd* c = arena_alloc(&rnd_cur->a, sizeof(rcmd));
+    if (!c) return NULL;
+    memset(c, 0, sizeof(rcmd));
+    c->op = op;
+    if (rnd_cur->tail) rnd_cur->tail->next = c;
+    else rnd_cur->head = c;
+    rnd_cur->tail = c;
+    rnd_cur->n++;
+    return c;
+}
+
+// Copy data the command needs past this frame's update
+static void* rnd_dup(const void* p, u32 sz)
+{
+    void* d = arena_alloc(&rnd_cur->a, sz);
+    if (d) memcpy(d, p, sz);
+    return d;
+}
+
+static void rnd_reset(rlist* l)
+{
+    arena_reset(&l->a);
+    l->head = l->tail = NULL;
+    l->n = 0;
+}
+
+static void rnd_tex(rctx* r, const rcmd* c)
+{
+    const col* px = (const col*)c->p;
     
-    if (!s.data) {
-        s.len = 0;
-        return s;
+    // Draw texture (pixel by pixel for now)
+    for (u32 y = 0; y < (u32)c->h; y++) {
+        for (u32 x = 0; x < (u32)c->w; x++) {
+            if (c->x + (s32)x < 0 || c->x + (s32)x >= 800 ||
+                c->y + (s32)y < 0 || c->y + (s32)y >= 600) {
+                continue;
+            }
+            
+            // Calculate texture coordinates
+            u32 tx = (x * c->n) / (u32)c->w;
+            u32 ty = (y * c->m) / (u32)c->h;
+            
+            // Get pixel color
+            col p = px[ty * c->n + tx];
+            
+            // Skip transparent pixels (black for now)
+            if (p.r == 0 && p.g == 0 && p.b == 0) continue;
+            
+            set_col(r, p);
+            XDrawPoint(r->dpy, e.wid, r->gc, c->x + x, c->y + y);
+            r->xreq++;
+        }
     }
+}
+
+static void rnd_font(rctx* r, const rcmd* c)
+{
+    const font* f = (const font*)c->p;
+    s32 dx = c->x;
+    
+    set_col(r, c->clr);
+    
+    // Collect lit pixels in scratch memory and send them in one request
+    u32 len = strlen(c->s);
+    XPoint* pts = arena_alloc(&r->scr, len * f->cw * f->ch * sizeof(XPoint));
+    if (!pts) return;
+    u32 npts = 0;
     
-    for (u32 i = 0; i < s.len; i++) {
-        s16 sample = 3000 * sin(2 * M_PI * hz * i / rate);
-        s.data[i] = sample;
+    // Draw each character
+    for (u32 i = 0; i < len; i++) {
+        u8 ch = c->s[i];
+        if (ch < f->first_char || ch >= f->first_char + f->num_chars) {
+            // Skip unknown characters
+            dx += f->cw;
+            continue;
+        }
+        
+        const font_char* fc = &f->chars[ch - f->first_char];
+        
+        // Draw character pixels
+        for (u8 y = 0; y < fc->h; y++) {
+            for (u8 x = 0; x < fc->w; x++) {
+                if (fc->data[y * fc->w + x]) {
+                    pts[npts].x = (short)(dx + x);
+                    pts[npts].y = (short)(c->y + y);
+                    npts++;
+                }
+            }
+        }
+        
+        dx += fc->w;
     }
     
-    return s;
+    if (npts) {
+        XDrawPoints(r->dpy, e.wid, r->gc, pts, npts, CoordModeOrigin);
+        r->xreq++;
+    }
 }
 
-// Generate square wave audio sample
-static snd gen_sqr(u32 hz, u32 ms, u32 rate)
+static void rnd_parts(rctx* r, const rcmd* c)
 {
-    snd s;
-    s.rate = rate;
-    s.ch = 1;
-    s.len = (rate * ms) / 1000;
-    s.data = malloc(s.len * sizeof(s16));
-    s.id = 0;
+    const part* ps = (const part*)c->p;
+    for (u32 i = 0; i < c->n; i++) {
+        const part* p = &ps[i];
+        if (!p->active) continue;
+        
+        // Calculate alpha based on life
+        f32 alpha = p->life / p->max_life;
+        
+        // Adjust color based on alpha
+        col draw_col = {
+            (u8)(p->clr.r * alpha),
+            (u8)(p->clr.g * alpha),
+            (u8)(p->clr.b * alpha)
+        };
+        
+        set_col(r, draw_col);
+        
+        // Draw different shapes based on type
+        switch (p->type) {
+            case PART_DUST:
+                XDrawPoint(r->dpy, e.wid, r->gc, (int)p->pos.x, (int)p->pos.y);
+                break;
+            case PART_SPARK:
+                XDrawLine(r->dpy, e.wid, r->gc,
+                         (int)p->pos.x, (int)p->pos.y,
+                         (int)(p->pos.x - p->vel.x),
+                         (int)(p->pos.y - p->vel.y));
+                break;
+            case PART_SMOKE:
+                XFillArc(r->dpy, e.wid, r->gc,
+                        (int)(p->pos.x - 2), (int)(p->pos.y - 2),
+                        4, 4, 0, 360*64);
+                break;
+        }
+        r->xreq++;
+    }
+}
+
+// Copy the background layer to the window, baking it first if stale
+static void rnd_bg(rctx* r, const rcmd* c)
+{
+    if (!r->bg || r->bg_ver < c->n) {
+        if (!r->bg) {
+            r->bg = XCreatePixmap(r->dpy, e.wid, 800, 600,
+                                  DefaultDepth(r->dpy, DefaultScreen(r->dpy)));
+            r->xreq++;
+        }
+        
+        // Window background, then the static sprites
+        pthread_mutex_lock(&rnd_mtx);
+        set_col(r, (col){255, 255, 255});
+        XFillRectangle(r->dpy, r->bg, r->gc, 0, 0, 800, 600);
+        r->xreq++;
+        for (u32 i = 0; i < bg_n; i++) {
+            const spr* s = &bg_spr[i];
+            set_col(r, s->clr);
+            XFillRectangle(r->dpy, r->bg, r->gc, (s32)s->pos.x, (s32)s->pos.y,
+                           (s32)s->sz.x, (s32)s->sz.y);
+            r->xreq++;
+        }
+        r->bg_ver = bg_ver;
+        pthread_mutex_unlock(&rnd_mtx);
+    }
     
-    if (!s.data) {
-        s.len = 0;
-        return s;
+    XCopyArea(r->dpy, r->bg, e.wid, r->gc, 0, 0, 800, 600, 0, 0);
+    r->xreq++;
+}
+
+// Rasterize a recorded frame
+static void rnd_exec(rctx* r, const rlist* l)
+{
+    PROF_BEG("rnd_exec");
+    for (const rcmd* c = l->head; c; c = c->next) {
+        switch (c->op) {
+            case RC_CLEAR:
+                XClearWindow(r->dpy, e.wid);
+                r->xreq++;
+                break;
+            case RC_RECT:
+                set_col(r, c->clr);
+                XFillRectangle(r->dpy, e.wid, r->gc, c->x, c->y, c->w, c->h);
+                r->xreq++;
+                break;
+            case RC_TEX:
+                rnd_tex(r, c);
+                break;
+            case RC_FONT:
+                rnd_font(r, c);
+                break;
+            case RC_STR:
+                set_col(r, c->clr);
+                XDrawString(r->dpy, e.wid, r->gc, c->x, c->y, c->s, c->n);
+                r->xreq++;
+                break;
+            case RC_PARTS:
+                rnd_parts(r, c);
+                break;
+            case RC_BG:
+                rnd_bg(r, c);
+                break;
+        }
+    }
+    arena_reset(&r->scr);
+    __atomic_store_n(&rnd_xreq, r->xreq, __ATOMIC_RELAXED);
+    r->xreq = 0;
+    PROF_END();
+}
+
+static void* rnd_main_fn(void* arg)
+{
+    (void)arg;
+    PROF_THREAD("render");
+    for (;;) {
+        pthread_mutex_lock(&rnd_mtx);
+        while (!rnd_new && !rnd_quit) {
+            pthread_cond_wait(&rnd_cv, &rnd_mtx);
+        }
+        if (rnd_quit) {
+            pthread_mutex_unlock(&rnd_mtx);
+            return NULL;
+        }
+        u32 t = rnd_r;
+        rnd_r = rnd_ready;
+        rnd_ready = t;
+        rnd_new = 0;
+        rnd_busy = 1;
+        pthread_mutex_unlock(&rnd_mtx);
+        
+        rnd_exec(&rnd_thr_ctx, &rnd_l[rnd_r]);
+        XFlush(rnd_thr_ctx.dpy);
+        __atomic_fetch_add(&rnd_drawn, 1, __ATOMIC_RELAXED);
+        
+        pthread_mutex_lock(&rnd_mtx);
+        rnd_busy = 0;
+        pthread_cond_broadcast(&rnd_cv);
+        pthread_mutex_unlock(&rnd_mtx);
+    }
+}
+
+// Finish the recorded frame: draw it now, or hand it to the render thread
+// and record the next one into the slot it gave back
+static void rnd_frame(void)
+{
+    if (!e.pipe) {
+        if (e.dpy) {
+            rnd_exec(&rnd_main, rnd_cur);
+            rnd_drawn++;
+        }
+        rnd_reset(rnd_cur);
+        return;
     }
     
-    u32 period = rate / hz;
-    for (u32 i = 0; i < s.len; i++) {
-        s16 sample = ((i % period) < (period / 2)) ? 8000 : -8000;
-        s.data[i] = sample;
+    pthread_mutex_lock(&rnd_mtx);
+    rnd_cur->fc = e.fc;
+    u32 t = rnd_w;
+    rnd_w = rnd_ready;
+    rnd_ready = t;
+    rnd_new = 1;
+    pthread_cond_broadcast(&rnd_cv);
+    pthread_mutex_unlock(&rnd_mtx);
+    
+    // Either a frame the renderer skipped or one it finished with
+    rnd_cur = &rnd_l[rnd_w];
+    rnd_reset(rnd_cur);
+}
+
+// Last frame no rasterizer still reads; textures used only up to it can
+// be freed without waiting for the render thread
+static u32 rnd_retired(void)
+{
+    u32 fc = e.fc - 1;
+    if (!e.pipe) return fc;
+    pthread_mutex_lock(&rnd_mtx);
+    if (rnd_new) fc = rnd_l[rnd_ready].fc - 1;
+    if (rnd_busy && (s32)(rnd_l[rnd_r].fc - 1 - fc) < 0) fc = rnd_l[rnd_r].fc - 1;
+    pthread_mutex_unlock(&rnd_mtx);
+    return fc;
+}
+
+// Throw away the frame being recorded (headless tools have no window)
+void rnd_drop(void)
+{
+    rnd_reset(rnd_cur);
+}
+
+// Choose pipelined rendering; call before ini()
+void rnd_pipe(u8 on)
+{
+    e.pipe = on;
+}
+
+// Wait until the render thread has drawn every handed-off frame, so the
+// resources they reference can be freed
+void rnd_sync(void)
+{
+    if (!e.pipe) return;
+    pthread_mutex_lock(&rnd_mtx);
+    while (rnd_new || rnd_busy) {
+        pthread_cond_wait(&rnd_cv, &rnd_mtx);
     }
+    pthread_mutex_unlock(&rnd_mtx);
+}
+
+// Start the render thread on its own X connection, so neither thread
+// needs Xlib locking
+static void rnd_ini(void)
+{
+    rnd_main.dpy = e.dpy;
+    rnd_main.gc = e.gc;
+    rnd_main.has_fg = 0;
     
-    return s;
+    // The layer copy would otherwise queue a NoExpose event per frame
+    XSetGraphicsExposures(e.dpy, e.gc, False);
+    if (!e.pipe) return;
+    
+    rnd_thr_ctx.dpy = XOpenDisplay(NULL);
+    if (rnd_thr_ctx.dpy) {
+        int s = DefaultScreen(rnd_thr_ctx.dpy);
+        XGCValues gv;
+        gv.foreground = BlackPixel(rnd_thr_ctx.dpy, s);
+        gv.background = WhitePixel(rnd_thr_ctx.dpy, s);
+        gv.line_width = 2;
+        gv.line_style = LineSolid;
+        gv.graphics_exposures = False;
+        rnd_thr_ctx.gc = XCreateGC(rnd_thr_ctx.dpy, e.wid,
+                                   GCForeground | GCBackground | GCLineWidth | GCLineStyle |
+                                   GCGraphicsExposures,
+                                   &gv);
+        rnd_thr_ctx.has_fg = 0;
+        rnd_quit = 0;
+        if (pthread_create(&rnd_thr, NULL, rnd_main_fn, NULL) == 0) {
+            printf("Pipelined rendering enabled\n");
+            return;
+        }
+        XFreeGC(rnd_thr_ctx.dpy, rnd_thr_ctx.gc);
+        XCloseDisplay(rnd_thr_ctx.dpy);
+    }
+    fprintf(stderr, "Render thread unavailable, drawing on the main thread\n");
+    e.pipe = 0;
+}
+
+static void rnd_fin(void)
+{
+    if (e.pipe) {
+        rnd_sync();
+        pthread_mutex_lock(&rnd_mtx);
+        rnd_quit = 1;
+        pthread_cond_broadcast(&rnd_cv);
+        pthread_mutex_unlock(&rnd_mtx);
+        pthread_join(rnd_thr, NULL);
+        
+        if (rnd_thr_ctx.bg) XFreePixmap(rnd_thr_ctx.dpy, rnd_thr_ctx.bg);
+        rnd_thr_ctx.bg = 0;
+        rnd_thr_ctx.bg_ver = 0;
+        XFreeGC(rnd_thr_ctx.dpy, rnd_thr_ctx.gc);
+        XCloseDisplay(rnd_thr_ctx.dpy);
+        arena_fin(&rnd_thr_ctx.scr);
+        e.pipe = 0;
+    }
+    for (u32 i = 0; i < 3; i++) {
+        arena_fin(&rnd_l[i].a);
+        rnd_l[i].head = rnd_l[i].tail = NULL;
+    }
+    arena_fin(&rnd_main.scr);
+    if (rnd_main.bg) XFreePixmap(rnd_main.dpy, rnd_main.bg);
+    rnd_main.bg = 0;
+    rnd_main.bg_ver = 0;
+    free(bg_spr);
+    bg_spr = NULL;
+    bg_n = bg_cap = 0;
+    free(bg_ext);
+    bg_ext = NULL;
+    bg_next = bg_ecap = 0;
+    bg_dirty = 1;
+    rnd_cur = &rnd_l[0];
+    rnd_w = 0;
+    rnd_ready = 1;
+    rnd_r = 2;
+    rnd_new = 0;
+}
+
+void drw_clear(void)
+{
+    rnd_add(RC_CLEAR);
+}
+
+// Text in the X server's default font (fallback when no font is loaded)
+void drw_str(v2 pos, col clr, const char* s)
+{
+    u32 len = strlen(s);
+    rcmd* c = rnd_add(RC_STR);
+    if (!c) return;
+    c->x = (s32)pos.x;
+    c->y = (s32)pos.y;
+    c->clr = clr;
+    c->s = rnd_dup(s, len + 1);
+    c->n = c->s ? len : 0;
 }
 
 // Vector functions implementation
@@ -155,6 +770,194 @@ f32 v2_len(v2 a) { return sqrtf(a.x * a.x + a.y * a.y); }
 v2 v2_nrm(v2 a) { f32 l = v2_len(a); return l > 0 ? v2_div(a, l) : v2_mk(0, 0); }
 f32 v2_dot(v2 a, v2 b) { return a.x * b.x + a.y * b.y; }
 
+// Arena functions implementation
+#define ARENA_MIN 65536
+
+// Heap allocations made by the engine, from any thread
+static u32 heap_n;
+
+// Counting wrappers; everything the engine allocates goes through these
+static void* mem_alloc(size_t sz)
+{
+    void* p = malloc(sz);
+    if (p) __atomic_fetch_add(&heap_n, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+static void* mem_calloc(size_t n, size_t sz)
+{
+    void* p = calloc(n, sz);
+    if (p) __atomic_fetch_add(&heap_n, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+static void* mem_realloc(void* p, size_t sz)
+{
+    void* np = realloc(p, sz);
+    if (np) __atomic_fetch_add(&heap_n, 1, __ATOMIC_RELAXED);
+    return np;
+}
+
+struct arena_blk {
+    arena_blk* prev;
+    u32 size;
+    u32 used;
+};
+
+// Block payload starts 16-byte aligned
+#define ARENA_HDR ((sizeof(arena_blk) + 15) & ~(size_t)15)
+
+void* arena_alloc(arena* a, u32 sz)
+{
+    sz = (sz + 15) & ~15u;
+    arena_blk* b = a->blk;
+    
+    if (!b || b->size - b->used < sz) {
+        u32 bsz = b ? b->size * 2 : ARENA_MIN;
+        if (bsz < sz) bsz = sz;
+        arena_blk* nb = mem_alloc(ARENA_HDR + bsz);
+        if (!nb) return NULL;
+        nb->prev = b;
+        nb->size = bsz;
+        nb->used = 0;
+        a->blk = b = nb;
+    }
+    
+    void* p = (u8*)b + ARENA_HDR + b->used;
+    b->used += sz;
+    a->used += sz;
+    return p;
+}
+
+// Invalidate everything allocated; overflow blocks are merged into one
+// block big enough for the whole cycle, so the next one allocates nothing
+void arena_reset(arena* a)
+{
+    arena_blk* b = a->blk;
+    if (b && b->prev) {
+        u32 total = 0;
+        while (b) {
+            arena_blk* prev = b->prev;
+            total += b->size;
+            free(b);
+            b = prev;
+        }
+        a->blk = NULL;
+        b = mem_alloc(ARENA_HDR + total);
+        if (b) {
+            b->prev = NULL;
+            b->size = total;
+            a->blk = b;
+        }
+    }
+    if (b) b->used = 0;
+    a->used = 0;
+}
+
+void arena_fin(arena* a)
+{
+    while (a->blk) {
+        arena_blk* prev = a->blk->prev;
+        free(a->blk);
+        a->blk = prev;
+    }
+    a->used = 0;
+}
+
+// Valid until the start of the next frame
+void* frame_alloc(u32 sz)
+{
+    return arena_alloc(&e.fa, sz);
+}
+
+// Valid until the calling scene leaves the stack; each level has its own
+// arena, so a covered scene that keeps running can still allocate
+void* scn_alloc(u32 sz)
+{
+    return arena_alloc(&e.sa[e.sm.lvl], sz);
+}
+
+// Grow a typed array geometrically so that it holds at least n items
+static void* arr_grow(void* p, u32* cap, u32 n, size_t sz)
+{
+    if (n <= *cap) return p;
+    u32 c = *cap ? *cap : 8;
+    while (c < n) c *= 2;
+    void* np = mem_realloc(p, c * sz);
+    if (!np) return NULL;
+    *cap = c;
+    return np;
+}
+
+// Handle pool functions implementation
+u32 hnd_new(hnd_pool* p)
+{
+    u32 slot;
+    if (p->free) {
+        slot = p->free - 1;
+        p->free = p->idx[slot];
+    } else {
+        if (p->top == p->cap) {
+            u32 cap = p->cap ? p->cap * 2 : 16;
+            if (cap > HND_IDX_MASK + 1) return 0;
+            u32* gen = mem_realloc(p->gen, cap * sizeof(u32));
+            if (!gen) return 0;
+            p->gen = gen;
+            u32* idx = mem_realloc(p->idx, cap * sizeof(u32));
+            if (!idx) return 0;
+            p->idx = idx;
+            u32* dns = mem_realloc(p->dns, cap * sizeof(u32));
+            if (!dns) return 0;
+            p->dns = dns;
+            p->cap = cap;
+        }
+        slot = p->top++;
+        p->gen[slot] = 1;
+    }
+    
+    // Append to the dense range
+    p->idx[slot] = p->n;
+    p->dns[p->n++] = slot;
+    return (p->gen[slot] << HND_IDX_BITS) | slot;
+}
+
+u32 hnd_idx(const hnd_pool* p, u32 h)
+{
+    u32 slot = h & HND_IDX_MASK;
+    if (slot >= p->top || p->gen[slot] != h >> HND_IDX_BITS) return HND_NONE;
+    return p->idx[slot];
+}
+
+// Release a handle; the last dense entry takes over the returned index,
+// so the caller must move its own data[n] into data[index]
+u32 hnd_del(hnd_pool* p, u32 h)
+{
+    u32 d = hnd_idx(p, h);
+    if (d == HND_NONE) return HND_NONE;
+    
+    u32 slot = h & HND_IDX_MASK;
+    u32 last = --p->n;
+    u32 moved = p->dns[last];
+    p->dns[d] = moved;
+    p->idx[moved] = d;
+    
+    // Bump generation so stale handles fail, then push onto free list
+    p->gen[slot] = (p->gen[slot] + 1) & HND_GEN_MASK;
+    if (!p->gen[slot]) p->gen[slot] = 1;
+    p->idx[slot] = p->free;
+    p->free = slot + 1;
+    return d;
+}
+
+void hnd_free(hnd_pool* p)
+{
+    free(p->gen);
+    free(p->idx);
+    free(p->dns);
+    p->gen = p->idx = p->dns = NULL;
+    p->cap = p->top = p->n = p->free = 0;
+}
+
 // Sprite functions implementation
 spr spr_mk(v2 pos, v2 sz, col clr)
 {
@@ -163,6 +966,7 @@ spr spr_mk(v2 pos, v2 sz, col clr)
     s.sz = sz;
     s.clr = clr;
     s.vis = 1;
+    s.stat = 0;
     s.id = 0;
     s.tex_id = 0;
     return s;
@@ -182,21 +986,63 @@ u8 mouse_btn(u8 btn)
     return 0;
 }
 
-void spr_add(spr s)
+u32 spr_add(spr s)
 {
-    if (e.ns % 10 == 0) {
-        e.sprs = realloc(e.sprs, (e.ns + 10) * sizeof(spr));
+    u32 cap = e.sp.cap;
+    u32 h = hnd_new(&e.sp);
+    if (!h) return 0;
+    
+    // Dense storage grows with the pool
+    if (e.sp.cap != cap) {
+        spr* sprs = mem_realloc(e.sprs, e.sp.cap * sizeof(spr));
+        if (!sprs) {
+            hnd_del(&e.sp, h);
+            return 0;
+        }
+        e.sprs = sprs;
     }
-    e.sprs[e.ns++] = s;
+    
+    s.id = h;
+    e.sprs[e.sp.n - 1] = s;
+    e.ns = e.sp.n;
+    if (s.stat) bg_dirty = 1;
+    return h;
+}
+
+void spr_del(u32 id)
+{
+    u32 d = hnd_idx(&e.sp, id);
+    if (d == HND_NONE) return;
+    if (e.sprs[d].stat) bg_dirty = 1;
+    hnd_del(&e.sp, id);
+    if (d < e.sp.n) e.sprs[d] = e.sprs[e.sp.n];
+    e.ns = e.sp.n;
 }
 
 void spr_drw(spr s)
 {
     if (!s.vis) return;
-    set_col(s.clr);
-    XFillRectangle(e.dpy, e.wid, e.gc, 
-                  (int)s.pos.x, (int)s.pos.y, 
-                  (int)s.sz.x, (int)s.sz.y);
+    rcmd* c = rnd_add(RC_RECT);
+    if (!c) return;
+    c->clr = s.clr;
+    c->x = (s32)s.pos.x;
+    c->y = (s32)s.pos.y;
+    c->w = (s32)s.sz.x;
+    c->h = (s32)s.sz.y;
+}
+
+// Record a textured quad; pixels stay owned by the texture
+static void tex_cmd(const tex* t, v2 pos, v2 sz)
+{
+    rcmd* c = rnd_add(RC_TEX);
+    if (!c) return;
+    c->p = t->data;
+    c->n = t->w;
+    c->m = t->h;
+    c->x = (s32)pos.x;
+    c->y = (s32)pos.y;
+    c->w = (s32)sz.x;
+    c->h = (s32)sz.y;
 }
 
 void spr_drw_tex(spr s)
@@ -209,28 +1055,7 @@ void spr_drw_tex(spr s)
         return;
     }
     
-    // Draw texture (pixel by pixel for now)
-    for (u32 y = 0; y < (u32)s.sz.y; y++) {
-        for (u32 x = 0; x < (u32)s.sz.x; x++) {
-            if (s.pos.x + x < 0 || s.pos.x + x >= 800 || 
-                s.pos.y + y < 0 || s.pos.y + y >= 600) {
-                continue;
-            }
-            
-            // Calculate texture coordinates
-            u32 tx = (x * t->w) / (u32)s.sz.x;
-            u32 ty = (y * t->h) / (u32)s.sz.y;
-            
-            // Get pixel color
-            col c = t->data[ty * t->w + tx];
-            
-            // Skip transparent pixels (black for now)
-            if (c.r == 0 && c.g == 0 && c.b == 0) continue;
-            
-            set_col(c);
-            XDrawPoint(e.dpy, e.wid, e.gc, (int)(s.pos.x + x), (int)(s.pos.y + y));
-        }
-    }
+    tex_cmd(t, s.pos, s.sz);
 }
 
 u8 spr_col(spr a, spr b)
@@ -242,324 +1067,1350 @@ u8 spr_col(spr a, spr b)
             a.pos.y + a.sz.y > b.pos.y);
 }
 
+// Static sprites returned here are assumed changed and re-baked
 spr* spr_get(u32 id)
 {
-    for (u32 i = 0; i < e.ns; i++) {
-        if (e.sprs[i].id == id) {
-            return &e.sprs[i];
+    u32 d = hnd_idx(&e.sp, id);
+    if (d == HND_NONE) return NULL;
+    if (e.sprs[d].stat) bg_dirty = 1;
+    return &e.sprs[d];
+}
+
+// Start the frame with the background layer: the window cleared and every
+// static sprite drawn, at the cost of one copy. Static sprites are baked
+// as flat rectangles
+void drw_bg(void)
+{
+    if (bg_dirty) {
+        pthread_mutex_lock(&rnd_mtx);
+        bg_n = 0;
+        for (u32 i = 0; i < e.ns + bg_next; i++) {
+            const spr* src = i < e.ns ? &e.sprs[i] : &bg_ext[i - e.ns];
+            if ((i < e.ns && !src->stat) || !src->vis) continue;
+            spr* s = arr_grow(bg_spr, &bg_cap, bg_n + 1, sizeof(spr));
+            if (!s) break;
+            bg_spr = s;
+            bg_spr[bg_n++] = *src;
         }
+        bg_ver++;
+        pthread_mutex_unlock(&rnd_mtx);
+        bg_dirty = 0;
     }
-    return NULL;
+    
+    rcmd* c = rnd_add(RC_BG);
+    if (c) c->n = bg_ver;
+}
+
+// Bake s[0..n) into the background layer with the static sprites, in
+// place of the previous set; for scenes whose static content is not in
+// the sprite array (e.g. entities). Copied, so s can be scratch memory
+void drw_bg_set(const spr* s, u32 n)
+{
+    spr* d = arr_grow(bg_ext, &bg_ecap, n, sizeof(spr));
+    if (n && !d) return;
+    bg_ext = d;
+    if (n) memcpy(bg_ext, s, n * sizeof(spr));
+    bg_next = n;
+    bg_dirty = 1;
 }
 
 // Texture functions implementation
-u32 tex_load(const char* path)
+#if X86_SIMD
+
+// 5 BGR pixels per 16-byte shuffle; byte 15 is rewritten by the next step
+__attribute__((target("ssse3")))
+static u32 bgr_row_ssse3(col* dst, const u8* src, u32 w)
 {
-    FILE* f = fopen(path, "rb");
-    if (!f) {
+    const __m128i m = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    u32 x = 0;
+    for (; x + 6 <= w; x += 5) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + x * 3));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_shuffle_epi8(v, m));
+    }
+    return x;
+}
+
+// 4 BGRA pixels in, 12 RGB bytes out per shuffle
+__attribute__((target("ssse3")))
+static u32 bgra_row_ssse3(col* dst, const u8* src, u32 w)
+{
+    const __m128i m = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    u32 x = 0;
+    for (; x + 6 <= w; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_shuffle_epi8(v, m));
+    }
+    return x;
+}
+#endif
+
+// BMP row converters (BGR(A) to RGB); simd selects the SSSE3 prefix
+static void bgr_row(col* dst, const u8* src, u32 w, u8 simd)
+{
+    u32 x = 0;
+#if X86_SIMD
+    if (simd) x = bgr_row_ssse3(dst, src, w);
+#else
+    (void)simd;
+#endif
+    for (; x < w; x++) {
+        dst[x].r = src[x * 3 + 2];
+        dst[x].g = src[x * 3 + 1];
+        dst[x].b = src[x * 3];
+    }
+}
+
+static void bgra_row(col* dst, const u8* src, u32 w, u8 simd)
+{
+    u32 x = 0;
+#if X86_SIMD
+    if (simd) x = bgra_row_ssse3(dst, src, w);
+#else
+    (void)simd;
+#endif
+    for (; x < w; x++) {
+        dst[x].r = src[x * 4 + 2];
+        dst[x].g = src[x * 4 + 1];
+        dst[x].b = src[x * 4];
+    }
+}
+
+// Expand RLE8 into one index per pixel (bottom-up rows, as stored)
+static u8 rle8_expand(u8* idx, u32 w, u32 h, const u8* p, const u8* end)
+{
+    u32 x = 0, y = 0;
+    while (p + 2 <= end) {
+        u8 n = *p++;
+        u8 c = *p++;
+        if (n) {
+            // Encoded run
+            while (n-- && x < w) idx[y * w + x++] = c;
+        } else if (c == 0) {
+            // End of line
+            x = 0;
+            if (++y >= h) return 1;
+        } else if (c == 1) {
+            return 1; // End of bitmap
+        } else if (c == 2) {
+            // Delta
+            if (p + 2 > end) return 0;
+            x += *p++;
+            y += *p++;
+            if (y >= h) return 1;
+        } else {
+            // Absolute run, padded to 16 bits
+            if (p + c > end) return 0;
+            for (u8 i = 0; i < c; i++) {
+                if (x < w) idx[y * w + x++] = p[i];
+            }
+            p += c + (c & 1);
+        }
+    }
+    return 1;
+}
+
+// Decode a BMP into a new texture; safe to call from loader threads.
+// Supports 24-bit, 32-bit (BI_RGB or standard BGRA bitfields), 8-bit
+// paletted and RLE8, bottom-up or top-down.
+static tex* bmp_decode(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, "Failed to open texture: %s\n", path);
-        return 0;
+        return NULL;
     }
     
-    // Read BMP header
-    bmp_hdr hdr;
-    if (fread(&hdr, sizeof(bmp_hdr), 1, f) != 1) {
-        fclose(f);
+    // Map the whole file; rows are converted straight from the mapping
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(bmp_hdr) + sizeof(bmp_info_hdr)) {
+        close(fd);
         fprintf(stderr, "Failed to read BMP header: %s\n", path);
-        return 0;
+        return NULL;
+    }
+    size_t size = st.st_size;
+    const u8* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map texture: %s\n", path);
+        return NULL;
     }
+    madvise((void*)map, size, MADV_SEQUENTIAL);
+    
+    bmp_hdr hdr;
+    bmp_info_hdr info;
+    memcpy(&hdr, map, sizeof(hdr));
+    memcpy(&info, map + sizeof(hdr), sizeof(info));
+    
+    const char* err = NULL;
+    tex* t = NULL;
+    u8* idx = NULL;
+    
+    // Check BMP signature and format
+    u8 rle = info.compression == 1;
+    u8 fields = info.compression == 3;
+    u32 w = info.width > 0 ? (u32)info.width : 0;
+    u32 h = info.height < 0 ? (u32)-(s64)info.height : (u32)info.height;
+    u8 top_down = info.height < 0;
     
-    // Check BMP signature
     if (hdr.type != 0x4D42) { // 'BM'
-        fclose(f);
-        fprintf(stderr, "Not a BMP file: %s\n", path);
-        return 0;
+        err = "Not a BMP file";
+    } else if (info.size < 40 || sizeof(hdr) + info.size > size) {
+        err = "Bad BMP info header";
+    } else if (!(info.bpp == 24 && info.compression == 0) &&
+               !(info.bpp == 32 && (info.compression == 0 || fields)) &&
+               !(info.bpp == 8 && (info.compression == 0 || rle))) {
+        err = "Unsupported BMP format (24/32-bit, 8-bit paletted or RLE8)";
+    } else if (!w || !h || w > 32768 || h > 32768 || (rle && top_down)) {
+        err = "Bad BMP dimensions";
+    } else if (hdr.offset > size) {
+        err = "Failed to read BMP pixel data";
     }
     
-    // Read info header
-    bmp_info_hdr info;
-    if (fread(&info, sizeof(bmp_info_hdr), 1, f) != 1) {
-        fclose(f);
-        fprintf(stderr, "Failed to read BMP info header: %s\n", path);
-        return 0;
+    // Bitfields must be plain BGRA; masks follow the 40-byte header
+    if (!err && fields) {
+        u32 mask[3];
+        if (sizeof(hdr) + 40 + sizeof(mask) > size) {
+            err = "Bad BMP info header";
+        } else {
+            memcpy(mask, map + sizeof(hdr) + 40, sizeof(mask));
+            if (mask[0] != 0x00FF0000 || mask[1] != 0x0000FF00 || mask[2] != 0x000000FF) {
+                err = "Unsupported BMP bitfields";
+            }
+        }
     }
     
-    // Check if supported format (24-bit uncompressed)
-    if (info.bpp != 24 || info.compression != 0) {
-        fclose(f);
-        fprintf(stderr, "Unsupported BMP format (must be 24-bit uncompressed): %s\n", path);
-        return 0;
+    // Palette (BGRX entries) follows the info header
+    col pal[256];
+    if (!err && info.bpp == 8) {
+        u32 npal = info.colors_used ? info.colors_used : 256;
+        const u8* pp = map + sizeof(hdr) + info.size;
+        if (npal > 256 || pp + npal * 4 > map + size) {
+            err = "Bad BMP palette";
+        } else {
+            memset(pal, 0, sizeof(pal));
+            for (u32 i = 0; i < npal; i++) {
+                pal[i].b = pp[i * 4];
+                pal[i].g = pp[i * 4 + 1];
+                pal[i].r = pp[i * 4 + 2];
+            }
+        }
     }
     
     // Allocate texture
-    tex* t = malloc(sizeof(tex));
-    if (!t) {
-        fclose(f);
-        fprintf(stderr, "Failed to allocate texture: %s\n", path);
-        return 0;
+    if (!err) {
+        t = mem_alloc(sizeof(tex));
+        if (t) t->data = mem_alloc((size_t)w * h * sizeof(col));
+        if (!t || !t->data) err = "Failed to allocate texture data";
     }
     
-    t->w = info.width;
-    t->h = abs(info.height); // Handle flipped BMPs
-    t->data = malloc(t->w * t->h * sizeof(col));
-    t->loaded = 0;
-    
-    if (!t->data) {
-        fclose(f);
-        free(t);
-        fprintf(stderr, "Failed to allocate texture data: %s\n", path);
-        return 0;
+    const u8* px = map + hdr.offset;
+    u32 row_size = ((w * info.bpp / 8 + 3) / 4) * 4; // Rows are padded to 4 bytes
+    if (!err && !rle && (u64)row_size * h > size - hdr.offset) {
+        err = "Failed to read BMP pixel data";
     }
     
-    // Seek to pixel data
-    fseek(f, hdr.offset, SEEK_SET);
-    
-    // Read pixel data (BMP stores pixels in BGR format)
-    u32 row_size = ((info.width * 3 + 3) / 4) * 4; // BMP rows are padded to 4 bytes
-    u8* row = malloc(row_size);
+    if (!err && rle) {
+        idx = mem_calloc((size_t)w * h, 1);
+        if (!idx) err = "Failed to allocate texture data";
+        else if (!rle8_expand(idx, w, h, px, map + size)) err = "Bad RLE8 data";
+        px = idx;
+        row_size = w;
+    }
     
-    for (s32 y = t->h - 1; y >= 0; y--) {
-        if (fread(row, 1, row_size, f) != row_size) {
-            free(row);
-            fclose(f);
-            free(t->data);
-            free(t);
-            fprintf(stderr, "Failed to read BMP pixel data: %s\n", path);
-            return 0;
-        }
-        
-        for (u32 x = 0; x < t->w; x++) {
-            u32 idx = y * t->w + x;
-            t->data[idx].b = row[x * 3];     // Blue
-            t->data[idx].g = row[x * 3 + 1]; // Green
-            t->data[idx].r = row[x * 3 + 2]; // Red
+    if (!err) {
+#if X86_SIMD
+        u8 simd = __builtin_cpu_supports("ssse3");
+#else
+        u8 simd = 0;
+#endif
+        for (u32 y = 0; y < h; y++) {
+            const u8* src = px + (size_t)y * row_size;
+            col* dst = t->data + (size_t)(top_down ? y : h - 1 - y) * w;
+            
+            if (info.bpp == 24) {
+                bgr_row(dst, src, w, simd);
+            } else if (info.bpp == 32) {
+                bgra_row(dst, src, w, simd);
+            } else {
+                for (u32 x = 0; x < w; x++) dst[x] = pal[src[x]];
+            }
         }
     }
     
-    free(row);
-    fclose(f);
+    free(idx);
+    munmap((void*)map, size);
+    
+    if (err) {
+        if (t) free(t->data);
+        free(t);
+        fprintf(stderr, "%s: %s\n", err, path);
+        return NULL;
+    }
     
+    t->w = w;
+    t->h = h;
     t->loaded = 1;
+    t->mapped = 0;
+    t->evicted = 0;
+    t->failed = 0;
+    t->last = 0;
+    t->path = NULL;
+    return t;
+}
+
+u32 tex_load(const char* path)
+{
+    // Reuse a cached copy of an unchanged file
+    s64 mtime = file_mtime(path);
+    u32 id = mtime >= 0 ? res_cache_get(RES_TEX, path, mtime) : 0;
+    if (id) return id;
+    
+    tex* t = bmp_decode(path);
+    if (!t) return 0;
+    t->path = str_dup(path);
+    t->last = e.fc;
     printf("Loaded texture: %s (%ux%u)\n", path, t->w, t->h);
     
     // Add to resource manager
     char name[16];
     snprintf(name, sizeof(name), "tex_%u", e.rm.next_id);
-    return res_add(t, RES_TEX, name);
+    id = res_add(t, RES_TEX, name);
+    if (id) res_cache_put(id, path, mtime);
+    return id;
 }
 
-void tex_drw(u32 id, v2 pos, v2 sz)
+// Job system: a fixed worker pool with one Chase-Lev deque per worker.
+// Owners push and pop at the bottom, idle workers steal from the top
+#define JOB_THREADS 16
+#define JOB_DEQ 1024  // deque capacity, power of two
+#define JOB_BLK 256   // job records allocated at a time
+
+typedef struct job {
+    job_fn fn;
+    job_for_fn ffn;  // range job if set
+    void* arg;
+    u32 beg, end, grain;
+    job_ctr* ctr;
+    job_ctr* dep;    // counter this job waits on
+    struct job* next;
+    u32 owner;       // worker whose free list it returns to
+} job;
+
+typedef struct job_blk {
+    struct job_blk* next;
+    job jobs[JOB_BLK];
+} job_blk;
+
+typedef struct {
+    s64 top;         // steal end
+    s64 bot;         // owner end
+    job* buf[JOB_DEQ];
+    job* free;       // owner's free records
+    job* ret;        // records freed by other workers (lock-free stack)
+    job_blk* blks;
+} job_deq;
+
+static job_deq* job_q;
+static pthread_t job_thr[JOB_THREADS];
+static u32 job_n;     // workers including the main thread
+static u8 job_quit;
+static u32 job_pend;  // queued jobs not yet taken
+static u32 job_idle;  // workers asleep
+static pthread_mutex_t job_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cv = PTHREAD_COND_INITIALIZER;
+static job* job_deps; // jobs waiting on a counter, under job_mtx
+static u32 job_ndep;
+static __thread s32 job_me = -1; // worker index, -1 outside the pool
+
+// Take a record from this worker's free list, reclaiming records other
+// workers finished, then growing by a block; NULL if out of memory
+static job* job_new(void)
 {
-    tex* t = tex_get(id);
-    if (!t || !t->loaded) return;
-    
-    // Draw texture (pixel by pixel for now)
-    for (u32 y = 0; y < (u32)sz.y; y++) {
-        for (u32 x = 0; x < (u32)sz.x; x++) {
-            if (pos.x + x < 0 || pos.x + x >= 800 || 
-                pos.y + y < 0 || pos.y + y >= 600) {
-                continue;
-            }
-            
-            // Calculate texture coordinates
-            u32 tx = (x * t->w) / (u32)sz.x;
-            u32 ty = (y * t->h) / (u32)sz.y;
-            
-            // Get pixel color
-            col c = t->data[ty * t->w + tx];
-            
-            // Skip transparent pixels (black for now)
-            if (c.r == 0 && c.g == 0 && c.b == 0) continue;
-            
-            set_col(c);
-            XDrawPoint(e.dpy, e.wid, e.gc, (int)(pos.x + x), (int)(pos.y + y));
+    job_deq* q = &job_q[job_me];
+    if (!q->free) q->free = __atomic_exchange_n(&q->ret, NULL, __ATOMIC_ACQUIRE);
+    if (!q->free) {
+        job_blk* blk = mem_alloc(sizeof(job_blk));
+        if (!blk) return NULL;
+        blk->next = q->blks;
+        q->blks = blk;
+        for (u32 i = 0; i < JOB_BLK; i++) {
+            blk->jobs[i].next = q->free;
+            q->free = &blk->jobs[i];
         }
     }
+    
+    job* j = q->free;
+    q->free = j->next;
+    memset(j, 0, sizeof(job));
+    j->owner = job_me;
+    return j;
 }
 
-tex* tex_get(u32 id)
+static void job_del(job* j)
 {
-    return (tex*)res_get(id);
+    job_deq* q = &job_q[j->owner];
+    if ((s32)j->owner == job_me) {
+        j->next = q->free;
+        q->free = j;
+        return;
+    }
+    
+    // Push only, and the owner takes the whole stack, so no ABA
+    j->next = __atomic_load_n(&q->ret, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&q->ret, &j->next, j, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
 }
 
-void tex_free(u32 id)
+// Owner end; returns 0 when the deque is full
+static u8 job_push(job* j)
 {
-    tex* t = tex_get(id);
-    if (t) {
-        if (t->data) free(t->data);
-        free(t);
+    job_deq* q = &job_q[job_me];
+    s64 b = __atomic_load_n(&q->bot, __ATOMIC_RELAXED);
+    s64 t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    if (b - t >= JOB_DEQ) return 0;
+    
+    // Count it before thieves can see it, so job_pend never underflows
+    __atomic_add_fetch(&job_pend, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&q->buf[b & (JOB_DEQ - 1)], j, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->bot, b + 1, __ATOMIC_RELEASE);
+    
+    // Wake a sleeper; it re-checks job_pend under the lock
+    if (__atomic_load_n(&job_idle, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&job_mtx);
+        pthread_cond_signal(&job_cv);
+        pthread_mutex_unlock(&job_mtx);
     }
-    res_del(id);
+    return 1;
 }
 
-// Font functions implementation
-u32 font_load(const char* path, u8 cw, u8 ch, u8 first_char)
+static job* job_take(job_deq* q)
 {
-    // Load the font texture
-    u32 tex_id = tex_load(path);
-    if (!tex_id) return 0;
-
-    tex* t = tex_get(tex_id);
-    if (!t || !t->loaded) return 0;
-
-    // Calculate characters per row
-    u8 chars_per_row = t->w / cw;
-    u8 num_chars = (t->h / ch) * chars_per_row;
-
-    // Allocate font
-    font* f = malloc(sizeof(font));
-    if (!f) {
-        tex_free(tex_id);
-        return 0;
+    s64 b = __atomic_load_n(&q->bot, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&q->bot, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    s64 t = __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+    
+    if (t > b) {
+        __atomic_store_n(&q->bot, b + 1, __ATOMIC_RELAXED);
+        return NULL;
     }
-
-    f->id = tex_id;
-    f->cw = cw;
-    f->ch = ch;
-    f->first_char = first_char;
-    f->num_chars = num_chars;
-    f->chars = malloc(num_chars * sizeof(font_char));
-    f->loaded = 0;
-
-    if (!f->chars) {
-        free(f);
-        tex_free(tex_id);
-        return 0;
+    job* j = __atomic_load_n(&q->buf[b & (JOB_DEQ - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        // Last one: race thieves for it
+        if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            j = NULL;
+        }
+        __atomic_store_n(&q->bot, b + 1, __ATOMIC_RELAXED);
     }
+    return j;
+}
 
-    // Extract character data from texture
-    for (u8 i = 0; i < num_chars; i++) {
-        u8 row = i / chars_per_row;
-        u8 col_idx = i % chars_per_row;  // Changed 'col' to 'col_idx'
+static job* job_steal(job_deq* q)
+{
+    s64 t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    s64 b = __atomic_load_n(&q->bot, __ATOMIC_ACQUIRE);
+    if (t >= b) return NULL;
+    
+    job* j = __atomic_load_n(&q->buf[t & (JOB_DEQ - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return j;
+}
 
-        f->chars[i].w = cw;
-        f->chars[i].h = ch;
-        f->chars[i].data = malloc(cw * ch * sizeof(u8));
+// Own deque first (LIFO, cache-warm), then steal round the others
+static job* job_next(void)
+{
+    u32 n = __atomic_load_n(&job_n, __ATOMIC_ACQUIRE);
+    job* j = job_take(&job_q[job_me]);
+    for (u32 i = 1; !j && i < n; i++) {
+        j = job_steal(&job_q[(job_me + i) % n]);
+    }
+    if (j) __atomic_sub_fetch(&job_pend, 1, __ATOMIC_SEQ_CST);
+    return j;
+}
 
-        if (!f->chars[i].data) {
-            // Clean up on failure
-            for (u8 j = 0; j < i; j++) {
-                free(f->chars[j].data);
-            }
-            free(f->chars);
-            free(f);
-            tex_free(tex_id);
-            return 0;
-        }
+static void job_exec(job* j);
 
-        // Extract character pixels (1-bit alpha: 0=transparent, 1=opaque)
-        for (u8 y = 0; y < ch; y++) {
-            for (u8 x = 0; x < cw; x++) {
-                u32 tex_x = col_idx * cw + x;  // Changed 'col' to 'col_idx'
-                u32 tex_y = row * ch + y;
-                col pixel = t->data[tex_y * t->w + tex_x];
+// Queue a job, or run it here when the deque is full
+static void job_put(job* j)
+{
+    if (!job_push(j)) job_exec(j);
+}
 
-                // Simple threshold for alpha (white = opaque, black = transparent)
-                f->chars[i].data[y * cw + x] = (pixel.r > 128 || pixel.g > 128 || pixel.b > 128) ? 1 : 0;
-            }
+// Queue jobs whose counter has reached zero
+static void job_release(job_ctr* ctr)
+{
+    job* ready = NULL;
+    pthread_mutex_lock(&job_mtx);
+    for (job** p = &job_deps; *p; ) {
+        job* j = *p;
+        if (j->dep == ctr && !__atomic_load_n(&ctr->n, __ATOMIC_SEQ_CST)) {
+            *p = j->next;
+            j->next = ready;
+            ready = j;
+            job_ndep--;
+        } else {
+            p = &j->next;
         }
     }
-
-    f->loaded = 1;
-    printf("Loaded font: %s (%ux%u, %u chars)\n", path, cw, ch, num_chars);
-
-    // Add to resource manager
-    char name[16];
-    snprintf(name, sizeof(name), "font_%u", e.rm.next_id);
-    return res_add(f, RES_FONT, name);
+    pthread_mutex_unlock(&job_mtx);
+    
+    while (ready) {
+        job* j = ready;
+        ready = j->next;
+        j->dep = NULL;
+        job_put(j);
+    }
 }
 
-void font_drw(u32 id, const char* text, v2 pos, col clr, u8 align)
+static void job_done(job_ctr* ctr)
 {
-    font* f = font_get(id);
-    if (!f || !f->loaded) return;
-    
-    // Calculate text width for alignment
-    u32 text_width = font_text_width(id, text);
-    v2 draw_pos = pos;
-    
-    // Adjust position based on alignment
-    switch (align) {
-        case FONT_CENTER:
-            draw_pos.x -= text_width / 2;
-            break;
-        case FONT_RIGHT:
-            draw_pos.x -= text_width;
-            break;
-        case FONT_LEFT:
-        default:
-            break;
+    if (!ctr) return;
+    if (__atomic_sub_fetch(&ctr->n, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&job_ndep, __ATOMIC_SEQ_CST)) {
+        job_release(ctr);
     }
+}
+
+static void job_exec(job* j)
+{
+    job w = *j;
+    job_del(j);
     
-    set_col(clr);
-    
-    // Draw each character
-    for (u32 i = 0; text[i] != '\0'; i++) {
-        u8 c = text[i];
-        if (c < f->first_char || c >= f->first_char + f->num_chars) {
-            // Skip unknown characters
-            draw_pos.x += f->cw;
-            continue;
-        }
-        
-        u8 char_idx = c - f->first_char;
-        font_char* fc = &f->chars[char_idx];
-        
-        // Draw character pixels
-        for (u8 y = 0; y < fc->h; y++) {
-            for (u8 x = 0; x < fc->w; x++) {
-                if (fc->data[y * fc->w + x]) {
-                    XDrawPoint(e.dpy, e.wid, e.gc, 
-                              (int)(draw_pos.x + x), (int)(draw_pos.y + y));
-                }
-            }
+    if (w.ffn) {
+        // Split off the upper half until grain-sized; the halves sit in
+        // this deque for idle workers to steal
+        while (w.end - w.beg > w.grain) {
+            job* h = job_new();
+            if (!h) break;
+            u32 mid = w.beg + (w.end - w.beg) / 2;
+            h->ffn = w.ffn;
+            h->arg = w.arg;
+            h->beg = mid;
+            h->end = w.end;
+            h->grain = w.grain;
+            h->ctr = w.ctr;
+            __atomic_add_fetch(&w.ctr->n, 1, __ATOMIC_SEQ_CST);
+            w.end = mid;
+            job_put(h);
         }
-        
-        draw_pos.x += fc->w;
+        w.ffn(w.arg, w.beg, w.end);
+    } else {
+        w.fn(w.arg);
     }
+    job_done(w.ctr);
 }
 
-void font_free(u32 id)
+static void* job_main(void* arg)
 {
-    font* f = font_get(id);
-    if (f) {
-        for (u8 i = 0; i < f->num_chars; i++) {
-            free(f->chars[i].data);
+    job_me = (s32)(size_t)arg;
+    PROF_THREAD("job");
+    for (;;) {
+        job* j = job_next();
+        if (j) {
+            job_exec(j);
+            continue;
         }
-        free(f->chars);
-        tex_free(f->id);
-        free(f);
+        
+        // Nothing to run or steal: sleep until a push
+        pthread_mutex_lock(&job_mtx);
+        __atomic_add_fetch(&job_idle, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&job_pend, __ATOMIC_SEQ_CST) && !job_quit) {
+            pthread_cond_wait(&job_cv, &job_mtx);
+        }
+        __atomic_sub_fetch(&job_idle, 1, __ATOMIC_SEQ_CST);
+        u8 quit = job_quit;
+        pthread_mutex_unlock(&job_mtx);
+        if (quit) return NULL;
     }
-    res_del(id);
 }
 
-font* font_get(u32 id)
+// Start nthr workers besides the main thread; 0 = one per spare core
+void job_ini(u32 nthr)
 {
-    return (font*)res_get(id);
+    if (job_q) return;
+    if (!nthr) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthr = cpus > 1 ? (u32)cpus - 1 : 0;
+    }
+    if (nthr > JOB_THREADS) nthr = JOB_THREADS;
+    
+    job_q = mem_calloc(nthr + 1, sizeof(job_deq));
+    if (!job_q) return;
+    job_quit = 0;
+    job_me = 0;
+    job_n = 1;
+    
+    // job_n only grows, so thieves never index a missing deque
+    for (u32 i = 0; i < nthr; i++) {
+        if (pthread_create(&job_thr[i], NULL, job_main, (void*)(size_t)(i + 1)) != 0) break;
+        __atomic_store_n(&job_n, i + 2, __ATOMIC_RELEASE);
+    }
+    printf("Job system initialized (%u workers)\n", job_n);
 }
 
-u32 font_text_width(u32 id, const char* text)
+void job_fin(void)
 {
-    font* f = font_get(id);
-    if (!f || !f->loaded) return 0;
+    if (!job_q) return;
     
-    u32 width = 0;
-    for (u32 i = 0; text[i] != '\0'; i++) {
-        u8 c = text[i];
-        if (c >= f->first_char && c < f->first_char + f->num_chars) {
-            width += f->cw;
-        } else {
-            width += f->cw; // Unknown characters still take space
+    pthread_mutex_lock(&job_mtx);
+    job_quit = 1;
+    pthread_cond_broadcast(&job_cv);
+    pthread_mutex_unlock(&job_mtx);
+    
+    for (u32 i = 0; i + 1 < job_n; i++) {
+        pthread_join(job_thr[i], NULL);
+    }
+    for (u32 i = 0; i < job_n; i++) {
+        while (job_q[i].blks) {
+            job_blk* blk = job_q[i].blks;
+            job_q[i].blks = blk->next;
+            free(blk);
         }
     }
-    
-    return width;
+    free(job_q);
+    job_q = NULL;
+    job_n = 0;
+    job_me = -1;
+    job_deps = NULL;
+    job_ndep = 0;
+    job_pend = 0;
 }
 
-// Particle functions implementation
-part part_mk(v2 pos, v2 vel, col clr, f32 life, u8 type)
+u32 job_threads(void)
 {
-    part p;
+    return job_q ? job_n : 1;
+}
+
+// Run fn(arg) on any worker; ctr (optional) counts it until it finishes.
+// Threads outside the pool run the job inline
+void job_run(job_fn fn, void* arg, job_ctr* ctr)
+{
+    job* j = job_me >= 0 ? job_new() : NULL;
+    if (!j) {
+        fn(arg);
+        return;
+    }
+    if (ctr) __atomic_add_fetch(&ctr->n, 1, __ATOMIC_SEQ_CST);
+    j->fn = fn;
+    j->arg = arg;
+    j->ctr = ctr;
+    job_put(j);
+}
+
+// Run fn(arg) once dep reaches zero; ctr counts it from now
+void job_after(job_fn fn, void* arg, job_ctr* dep, job_ctr* ctr)
+{
+    job* j = job_me >= 0 ? job_new() : NULL;
+    if (!j) {
+        job_wait(dep);
+        fn(arg);
+        return;
+    }
+    if (ctr) __atomic_add_fetch(&ctr->n, 1, __ATOMIC_SEQ_CST);
+    j->fn = fn;
+    j->arg = arg;
+    j->ctr = ctr;
+    j->dep = dep;
+    
+    // Park it unless dep is already clear; job_done sees job_ndep
+    pthread_mutex_lock(&job_mtx);
+    __atomic_add_fetch(&job_ndep, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&dep->n, __ATOMIC_SEQ_CST)) {
+        j->next = job_deps;
+        job_deps = j;
+        j = NULL;
+    } else {
+        __atomic_sub_fetch(&job_ndep, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&job_mtx);
+    
+    if (j) {
+        j->dep = NULL;
+        job_put(j);
+    }
+}
+
+// Call fn over [0, n) in slices of at most grain, split recursively so
+// idle workers steal large halves first
+void job_for(job_for_fn fn, void* arg, u32 n, u32 grain, job_ctr* ctr)
+{
+    if (!n) return;
+    if (!grain) grain = 1;
+    if (job_me < 0 || (n <= grain && !ctr)) {
+        fn(arg, 0, n);
+        return;
+    }
+    
+    job* j = job_new();
+    if (!j) {
+        fn(arg, 0, n);
+        return;
+    }
+    job_ctr local = {0};
+    if (!ctr) ctr = &local;
+    __atomic_add_fetch(&ctr->n, 1, __ATOMIC_SEQ_CST);
+    j->ffn = fn;
+    j->arg = arg;
+    j->end = n;
+    j->grain = grain;
+    j->ctr = ctr;
+    job_exec(j);
+    if (ctr == &local) job_wait(&local);
+}
+
+// Wait for ctr to reach zero, running queued jobs meanwhile
+void job_wait(job_ctr* ctr)
+{
+    while (__atomic_load_n(&ctr->n, __ATOMIC_ACQUIRE)) {
+        job* j = job_me >= 0 ? job_next() : NULL;
+        if (j) {
+            job_exec(j);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+// Async loader: worker threads decode, the main thread publishes results
+#define LD_THREADS 2
+#define LD_RING 64 // completion ring size, power of two
+
+typedef struct ld_job {
+    struct ld_job* next;
+    u32 id;         // pending texture handle
+    char path[];
+} ld_job;
+
+typedef struct {
+    u32 seq;        // ring slot sequence
+    u32 id;
+    tex* t;         // decoded texture, NULL on failure
+    ld_job* job;
+} ld_done;
+
+static pthread_t ld_thr[LD_THREADS];
+static u32 ld_nthr;
+static pthread_mutex_t ld_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ld_cv = PTHREAD_COND_INITIALIZER;
+static ld_job* ld_head;
+static ld_job* ld_tail;
+static u8 ld_quit;
+
+// Bounded MPSC completion queue (per-slot sequence numbers, no locks)
+static ld_done ld_ring[LD_RING];
+static u32 ld_wpos;
+static u32 ld_rpos;
+
+static void ld_push(u32 id, tex* t, ld_job* job)
+{
+    for (;;) {
+        u32 pos = __atomic_load_n(&ld_wpos, __ATOMIC_RELAXED);
+        ld_done* d = &ld_ring[pos & (LD_RING - 1)];
+        s32 dif = (s32)(__atomic_load_n(&d->seq, __ATOMIC_ACQUIRE) - pos);
+        
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&ld_wpos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                d->id = id;
+                d->t = t;
+                d->job = job;
+                __atomic_store_n(&d->seq, pos + 1, __ATOMIC_RELEASE);
+                return;
+            }
+        } else if (dif < 0) {
+            // Full: wait for the main thread to drain, unless it is shutting
+            // down and will not poll again
+            if (__atomic_load_n(&ld_quit, __ATOMIC_ACQUIRE)) {
+                if (t) {
+                    free(t->data);
+                    free(t);
+                }
+                free(job);
+                return;
+            }
+            sched_yield();
+        }
+    }
+}
+
+static u8 ld_pop(ld_done* out)
+{
+    ld_done* d = &ld_ring[ld_rpos & (LD_RING - 1)];
+    if (__atomic_load_n(&d->seq, __ATOMIC_ACQUIRE) != ld_rpos + 1) return 0;
+    
+    *out = *d;
+    __atomic_store_n(&d->seq, ld_rpos + LD_RING, __ATOMIC_RELEASE);
+    ld_rpos++;
+    return 1;
+}
+
+static void* ld_main(void* arg)
+{
+    (void)arg;
+    PROF_THREAD("loader");
+    for (;;) {
+        pthread_mutex_lock(&ld_mtx);
+        while (!ld_head && !ld_quit) {
+            pthread_cond_wait(&ld_cv, &ld_mtx);
+        }
+        if (ld_quit) {
+            pthread_mutex_unlock(&ld_mtx);
+            return NULL;
+        }
+        ld_job* j = ld_head;
+        ld_head = j->next;
+        if (!ld_head) ld_tail = NULL;
+        pthread_mutex_unlock(&ld_mtx);
+        
+        PROF_BEG("bmp_decode");
+        tex* t = bmp_decode(j->path);
+        PROF_END();
+        ld_push(j->id, t, j);
+    }
+}
+
+static void ld_ini(void)
+{
+    for (u32 i = 0; i < LD_RING; i++) {
+        ld_ring[i].seq = i;
+    }
+    ld_wpos = ld_rpos = 0;
+    ld_quit = 0;
+    
+    for (ld_nthr = 0; ld_nthr < LD_THREADS; ld_nthr++) {
+        if (pthread_create(&ld_thr[ld_nthr], NULL, ld_main, NULL) != 0) break;
+    }
+}
+
+// Publish finished loads; called once per frame on the main thread
+static void ld_poll(void)
+{
+    ld_done d;
+    while (ld_pop(&d)) {
+        tex* t = tex_get(d.id);
+        
+        if (!t || !d.t) {
+            // Texture was freed while pending, or decode failed
+            if (d.t) {
+                free(d.t->data);
+                free(d.t);
+            }
+            if (t) {
+                // Keep the dead placeholder out of the cache so the next
+                // load of this path tries again
+                t->failed = 1;
+                res_uncache(&e.rm.ress[hnd_idx(&e.rm.hp, d.id)]);
+            }
+        } else {
+            t->w = d.t->w;
+            t->h = d.t->h;
+            t->data = d.t->data;
+            t->loaded = 1;
+            free(d.t);
+            res_account(d.id);
+            printf("Loaded texture: %s (%ux%u)\n", d.job->path, t->w, t->h);
+        }
+        free(d.job);
+    }
+}
+
+static void ld_fin(void)
+{
+    pthread_mutex_lock(&ld_mtx);
+    __atomic_store_n(&ld_quit, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&ld_cv);
+    pthread_mutex_unlock(&ld_mtx);
+    
+    for (u32 i = 0; i < ld_nthr; i++) {
+        pthread_join(ld_thr[i], NULL);
+    }
+    ld_nthr = 0;
+    
+    // Drop queued jobs and publish whatever already finished
+    while (ld_head) {
+        ld_job* j = ld_head;
+        ld_head = j->next;
+        free(j);
+    }
+    ld_tail = NULL;
+    ld_poll();
+}
+
+// Returns a texture handle immediately; it draws as a placeholder until
+// the loader has decoded the file
+u32 tex_load_async(const char* path)
+{
+    // Recorded and replayed runs load in place: a scene switch waiting on
+    // the loader would land on a different frame each run
+    if (!ld_nthr || inp_mode) return tex_load(path);
+    
+    // Cache hits may still be pending
+    s64 mtime = file_mtime(path);
+    u32 hit = mtime >= 0 ? res_cache_get(RES_TEX, path, mtime) : 0;
+    if (hit) return hit;
+    
+    size_t len = strlen(path) + 1;
+    ld_job* j = mem_alloc(sizeof(ld_job) + len);
+    tex* t = mem_alloc(sizeof(tex));
+    if (!j || !t) {
+        free(j);
+        free(t);
+        return 0;
+    }
+    
+    t->w = 0;
+    t->h = 0;
+    t->data = NULL;
+    t->loaded = 0;
+    t->mapped = 0;
+    t->evicted = 0;
+    t->failed = 0;
+    t->last = e.fc;
+    t->path = str_dup(path);
+    
+    char name[16];
+    snprintf(name, sizeof(name), "tex_%u", e.rm.next_id);
+    u32 id = res_add(t, RES_TEX, name);
+    if (!id) {
+        free(j);
+        free(t);
+        return 0;
+    }
+    res_cache_put(id, path, mtime);
+    
+    j->next = NULL;
+    j->id = id;
+    memcpy(j->path, path, len);
+    
+    pthread_mutex_lock(&ld_mtx);
+    if (ld_tail) ld_tail->next = j;
+    else ld_head = j;
+    ld_tail = j;
+    pthread_cond_signal(&ld_cv);
+    pthread_mutex_unlock(&ld_mtx);
+    
+    return id;
+}
+
+u8 tex_ready(u32 id)
+{
+    tex* t = tex_get(id);
+    return t && t->loaded;
+}
+
+void tex_drw(u32 id, v2 pos, v2 sz)
+{
+    PROF_BEG("tex_drw");
+    tex* t = tex_get(id);
+    if (t && !t->loaded) {
+        // Placeholder until an async load completes
+        spr s = spr_mk(pos, sz, (col){128, 128, 128});
+        spr_drw(s);
+    } else if (t) {
+        tex_cmd(t, pos, sz);
+    }
+    PROF_END();
+}
+
+// Drop pixel data of least recently used textures until the residency cap
+// holds; keep is never evicted. Textures used this frame are skipped, as
+// commands recorded so far point at their pixels
+static void tex_trim(u32 keep)
+{
+    if (!e.rm.tex_cap || res_bytes(RES_TEX) <= e.rm.tex_cap) return;
+    
+    // Handed-off frames hold raw pixel pointers, so only textures the
+    // rasterizers are done with go; the rest wait for a later frame
+    u32 done = rnd_retired();
+    while (res_bytes(RES_TEX) > e.rm.tex_cap) {
+        res* lru = NULL;
+        for (u32 i = 0; i < e.rm.nr; i++) {
+            res* r = &e.rm.ress[i];
+            if (r->type != RES_TEX || r->id == keep) continue;
+            tex* t = (tex*)r->data;
+            if (!t->loaded || t->mapped || !t->path || (s32)(t->last - done) > 0) continue;
+            if (!lru || (s32)(t->last - ((tex*)lru->data)->last) < 0) lru = r;
+        }
+        if (!lru) return;
+        
+        tex* t = (tex*)lru->data;
+        free(t->data);
+        t->data = NULL;
+        t->loaded = 0;
+        t->evicted = 1;
+        e.rm.evicts++;
+        res_account(lru->id);
+    }
+}
+
+// Cap the bytes held by resident textures (0 = unlimited)
+void tex_budget(u64 bytes)
+{
+    e.rm.tex_cap = bytes;
+    tex_trim(0);
+}
+
+tex* tex_get(u32 id)
+{
+    tex* t = (tex*)res_get(id);
+    if (!t) return NULL;
+    t->last = e.fc;
+    
+    // Evicted textures come back from their source file
+    if (t->evicted) {
+        tex* n = bmp_decode(t->path);
+        if (!n) return t; // Stays a placeholder
+        t->data = n->data;
+        t->w = n->w;
+        t->h = n->h;
+        t->loaded = 1;
+        t->evicted = 0;
+        free(n);
+        e.rm.reloads++;
+        res_account(id);
+    }
+    return t;
+}
+
+void tex_free(u32 id)
+{
+    res_release(id);
+}
+
+// Font functions implementation
+u32 font_load(const char* path, u8 cw, u8 ch, u8 first_char)
+{
+    // Same file and glyph layout share one font
+    char key[288];
+    s64 mtime = file_mtime(path);
+    snprintf(key, sizeof(key), "%s:%ux%u+%u", path, cw, ch, first_char);
+    u32 id = mtime >= 0 ? res_cache_get(RES_FONT, key, mtime) : 0;
+    if (id) return id;
+    
+    // Load the font texture
+    u32 tex_id = tex_load(path);
+    if (!tex_id) return 0;
+
+    tex* t = tex_get(tex_id);
+    if (!t || !t->loaded) {
+        tex_free(tex_id);
+        return 0;
+    }
+
+    // Calculate characters per row
+    u8 chars_per_row = t->w / cw;
+    u8 num_chars = (t->h / ch) * chars_per_row;
+
+    // Allocate font
+    font* f = mem_alloc(sizeof(font));
+    if (!f) {
+        tex_free(tex_id);
+        return 0;
+    }
+
+    f->id = tex_id;
+    f->cw = cw;
+    f->ch = ch;
+    f->first_char = first_char;
+    f->num_chars = num_chars;
+    f->chars = mem_alloc(num_chars * sizeof(font_char));
+    f->loaded = 0;
+    f->mapped = 0;
+
+    if (!f->chars) {
+        free(f);
+        tex_free(tex_id);
+        return 0;
+    }
+
+    // All glyph bitmaps share one block
+    u8* glyphs = mem_alloc(num_chars * cw * ch * sizeof(u8));
+    if (!glyphs) {
+        free(f->chars);
+        free(f);
+        tex_free(tex_id);
+        return 0;
+    }
+
+    // Extract character data from texture
+    for (u8 i = 0; i < num_chars; i++) {
+        u8 row = i / chars_per_row;
+        u8 col_idx = i % chars_per_row;  // Changed 'col' to 'col_idx'
+
+        f->chars[i].w = cw;
+        f->chars[i].h = ch;
+        f->chars[i].data = glyphs + (u32)i * cw * ch;
+
+        // Extract character pixels (1-bit alpha: 0=transparent, 1=opaque)
+        for (u8 y = 0; y < ch; y++) {
+            for (u8 x = 0; x < cw; x++) {
+                u32 tex_x = col_idx * cw + x;  // Changed 'col' to 'col_idx'
+                u32 tex_y = row * ch + y;
+                col pixel = t->data[tex_y * t->w + tex_x];
+
+                // Simple threshold for alpha (white = opaque, black = transparent)
+                f->chars[i].data[y * cw + x] = (pixel.r > 128 || pixel.g > 128 || pixel.b > 128) ? 1 : 0;
+            }
+        }
+    }
+
+    f->loaded = 1;
+    printf("Loaded font: %s (%ux%u, %u chars)\n", path, cw, ch, num_chars);
+
+    // Add to resource manager
+    char name[16];
+    snprintf(name, sizeof(name), "font_%u", e.rm.next_id);
+    id = res_add(f, RES_FONT, name);
+    if (id) res_cache_put(id, key, mtime);
+    return id;
+}
+
+void font_drw(u32 id, const char* text, v2 pos, col clr, u8 align)
+{
+    font* f = font_get(id);
+    if (!f || !f->loaded) return;
+    
+    // Calculate text width for alignment
+    u32 text_width = font_text_width(id, text);
+    v2 draw_pos = pos;
+    
+    // Adjust position based on alignment
+    switch (align) {
+        case FONT_CENTER:
+            draw_pos.x -= text_width / 2;
+            break;
+        case FONT_RIGHT:
+            draw_pos.x -= text_width;
+            break;
+        case FONT_LEFT:
+        default:
+            break;
+    }
+    
+    // Glyphs are expanded when the frame is rasterized
+    PROF_BEG("font_drw");
+    rcmd* c = rnd_add(RC_FONT);
+    if (c) {
+        c->p = f;
+        c->s = rnd_dup(text, strlen(text) + 1);
+        if (!c->s) c->s = "";
+        c->clr = clr;
+        c->x = (s32)draw_pos.x;
+        c->y = (s32)draw_pos.y;
+    }
+    PROF_END();
+}
+
+void font_free(u32 id)
+{
+    res_release(id);
+}
+
+font* font_get(u32 id)
+{
+    return (font*)res_get(id);
+}
+
+u32 font_text_width(u32 id, const char* text)
+{
+    font* f = font_get(id);
+    if (!f || !f->loaded) return 0;
+    
+    u32 width = 0;
+    for (u32 i = 0; text[i] != '\0'; i++) {
+        u8 c = text[i];
+        if (c >= f->first_char && c < f->first_char + f->num_chars) {
+            width += f->cw;
+        } else {
+            width += f->cw; // Unknown characters still take space
+        }
+    }
+    
+    return width;
+}
+
+// Asset pack functions implementation
+u32 pak_open(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(pak_hdr) ||
+        (u64)st.st_size > 0xFFFFFFFFu) {
+        close(fd);
+        fprintf(stderr, "Invalid pack: %s\n", path);
+        return 0;
+    }
+    
+    // Map read-only; pages fault in only for assets that are touched
+    u8* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map pack: %s\n", path);
+        return 0;
+    }
+    
+    const pak_hdr* hdr = (const pak_hdr*)base;
+    if (hdr->magic != PAK_MAGIC || hdr->ver != PAK_VER ||
+        hdr->idx_off > st.st_size ||
+        hdr->n > (st.st_size - hdr->idx_off) / sizeof(pak_ent)) {
+        munmap(base, st.st_size);
+        fprintf(stderr, "Invalid pack: %s\n", path);
+        return 0;
+    }
+    
+    pak* p = mem_alloc(sizeof(pak));
+    if (!p) {
+        munmap(base, st.st_size);
+        return 0;
+    }
+    
+    p->base = base;
+    p->size = st.st_size;
+    p->ents = (const pak_ent*)(base + hdr->idx_off);
+    p->n = hdr->n;
+    
+    // The index is scanned on every lookup, fault it in now
+    u32 pg = hdr->idx_off & ~(u32)(sysconf(_SC_PAGESIZE) - 1);
+    madvise(base + pg, p->size - pg, MADV_WILLNEED);
+    
+    printf("Opened pack: %s (%u entries)\n", path, p->n);
+    return res_add(p, RES_PAK, "pak");
+}
+
+void pak_close(u32 id)
+{
+    res_del(id);
+}
+
+const pak_ent* pak_find(u32 id, const char* name)
+{
+    pak* p = (pak*)res_get(id);
+    if (!p) return NULL;
+    
+    for (u32 i = 0; i < p->n; i++) {
+        const pak_ent* en = &p->ents[i];
+        if (strncmp(en->name, name, sizeof(en->name)) == 0) {
+            // Reject entries that point outside the mapping
+            if (en->off > p->size || en->size > p->size - en->off) return NULL;
+            return en;
+        }
+    }
+    return NULL;
+}
+
+// Assets created from a pack reference its pages directly, so the pack must
+// stay open until they are freed
+u32 pak_tex(u32 id, const char* name)
+{
+    char key[48];
+    snprintf(key, sizeof(key), "pak%u:%s", id, name);
+    u32 hit = res_cache_get(RES_TEX, key, 0);
+    if (hit) return hit;
+    
+    const pak_ent* en = pak_find(id, name);
+    if (!en || en->type != RES_TEX || (u64)en->a * en->b * sizeof(col) != en->size) return 0;
+    
+    tex* t = mem_alloc(sizeof(tex));
+    if (!t) return 0;
+    
+    pak* p = (pak*)res_get(id);
+    t->w = en->a;
+    t->h = en->b;
+    t->data = (col*)(p->base + en->off);
+    t->loaded = 1;
+    t->mapped = 1;
+    t->evicted = 0;
+    t->failed = 0;
+    t->last = e.fc;
+    t->path = NULL;
+    
+    u32 rid = res_add(t, RES_TEX, en->name);
+    if (rid) res_cache_put(rid, key, 0);
+    return rid;
+}
+
+u32 pak_font(u32 id, const char* name)
+{
+    char key[48];
+    snprintf(key, sizeof(key), "pak%u:%s", id, name);
+    u32 hit = res_cache_get(RES_FONT, key, 0);
+    if (hit) return hit;
+    
+    const pak_ent* en = pak_find(id, name);
+    if (!en || en->type != RES_FONT || en->d > 255 ||
+        (u64)en->a * en->b * en->d != en->size) return 0;
+    
+    font* f = mem_alloc(sizeof(font));
+    if (!f) return 0;
+    
+    pak* p = (pak*)res_get(id);
+    f->id = 0; // No backing texture
+    f->cw = en->a;
+    f->ch = en->b;
+    f->first_char = en->c;
+    f->num_chars = en->d;
+    f->chars = mem_alloc(f->num_chars * sizeof(font_char));
+    f->loaded = 0;
+    f->mapped = 1;
+    
+    if (!f->chars) {
+        free(f);
+        return 0;
+    }
+    
+    // Glyph bitmaps are stored back to back
+    u8* glyphs = p->base + en->off;
+    for (u8 i = 0; i < f->num_chars; i++) {
+        f->chars[i].w = f->cw;
+        f->chars[i].h = f->ch;
+        f->chars[i].data = glyphs + (u32)i * f->cw * f->ch;
+    }
+    
+    f->loaded = 1;
+    u32 rid = res_add(f, RES_FONT, en->name);
+    if (rid) res_cache_put(rid, key, 0);
+    return rid;
+}
+
+u32 pak_snd(u32 id, const char* name)
+{
+    char key[48];
+    snprintf(key, sizeof(key), "pak%u:%s", id, name);
+    u32 hit = res_cache_get(RES_SND, key, 0);
+    if (hit) return hit;
+    
+    const pak_ent* en = pak_find(id, name);
+    if (!en || en->type != RES_SND || !en->c ||
+        (u64)en->a * en->c * sizeof(s16) != en->size) return 0;
+    
+    snd* sn = mem_alloc(sizeof(snd));
+    if (!sn) return 0;
+    
+    pak* p = (pak*)res_get(id);
+    sn->data = (s16*)(p->base + en->off);
+    sn->len = en->a;
+    sn->rate = en->b;
+    sn->ch = en->c;
+    sn->id = 0;
+    sn->mapped = 1;
+    
+    u32 rid = res_add(sn, RES_SND, en->name);
+    if (rid) res_cache_put(rid, key, 0);
+    return rid;
+}
+
+// Particle functions implementation
+part part_mk(v2 pos, v2 vel, col clr, f32 life, u8 type)
+{
+    part p;
     p.pos = pos;
     p.vel = vel;
     p.acc = v2_mk(0, 0);
@@ -571,396 +2422,2046 @@ part part_mk(v2 pos, v2 vel, col clr, f32 life, u8 type)
     return p;
 }
 
-part_emit part_emit_mk(v2 pos, v2 vel_range, f32 life_range, u8 type, u32 rate)
+part_emit part_emit_mk(v2 pos, v2 vel_range, f32 life_range, u8 type, u32 rate)
+{
+    part_emit e;
+    e.pos = pos;
+    e.vel_range = vel_range;
+    e.life_range = life_range;
+    e.type = type;
+    e.active = 1;
+    e.rate = rate;
+    e.count = 0;
+    return e;
+}
+
+void part_emit_gen(part_emit* e)
+{
+    if (!e->active) return;
+    
+    e->count++;
+    if (e->count >= e->rate) {
+        e->count = 0;
+        
+        // Generate random velocity within range
+        v2 vel = v2_mk(
+            ((f32)rand() / RAND_MAX) * e->vel_range.x * 2 - e->vel_range.x,
+            ((f32)rand() / RAND_MAX) * e->vel_range.y * 2 - e->vel_range.y
+        );
+        
+        // Generate random life within range
+        f32 life = ((f32)rand() / RAND_MAX) * e->life_range;
+        
+        // Set color based on type
+        col clr;
+        switch (e->type) {
+            case PART_DUST:
+                clr = (col){200, 200, 200}; // Gray
+                break;
+            case PART_SPARK:
+                clr = (col){255, 255, 100}; // Yellow
+                break;
+            case PART_SMOKE:
+                clr = (col){100, 100, 100}; // Dark gray
+                break;
+            default:
+                clr = (col){255, 255, 255}; // White
+        }
+        
+        part_add(e->pos, vel, clr, life, e->type);
+    }
+}
+
+// Storage is kept across part_init/part_clear and freed in fin()
+void part_init(void)
+{
+    e.np = 0;
+    e.ne = 0;
+}
+
+void part_add(v2 pos, v2 vel, col clr, f32 life, u8 type)
+{
+    if (e.np == e.pcap) {
+        part* parts = arr_grow(e.parts, &e.pcap, e.np + 1, sizeof(part));
+        if (!parts) return;
+        e.parts = parts;
+    }
+    e.parts[e.np++] = part_mk(pos, vel, clr, life, type);
+}
+
+void part_emit_add(v2 pos, v2 vel_range, f32 life_range, u8 type, u32 rate)
+{
+    if (e.ne == e.ecap) {
+        part_emit* emits = arr_grow(e.emits, &e.ecap, e.ne + 1, sizeof(part_emit));
+        if (!emits) return;
+        e.emits = emits;
+    }
+    e.emits[e.ne++] = part_emit_mk(pos, vel_range, life_range, type, rate);
+}
+
+void part_upd(void)
+{
+    PROF_BEG("part_upd");
+    
+    // Update particles
+    for (u32 i = 0; i < e.np; i++) {
+        if (!e.parts[i].active) continue;
+        
+        // Apply acceleration (gravity for dust/smoke, none for sparks)
+        if (e.parts[i].type != PART_SPARK) {
+            e.parts[i].acc.y += 0.05f;
+        }
+        
+        // Update velocity and position
+        e.parts[i].vel = v2_add(e.parts[i].vel, e.parts[i].acc);
+        e.parts[i].pos = v2_add(e.parts[i].pos, e.parts[i].vel);
+        
+        // Decrease life
+        e.parts[i].life -= 0.016f; // ~60fps
+        
+        // Deactivate if life is over
+        if (e.parts[i].life <= 0) {
+            e.parts[i].active = 0;
+        }
+    }
+    
+    // Compact dead particles so the array stops growing in steady state
+    u32 n = 0;
+    for (u32 i = 0; i < e.np; i++) {
+        if (e.parts[i].active) e.parts[n++] = e.parts[i];
+    }
+    e.np = n;
+    
+    // Generate particles from emitters
+    for (u32 i = 0; i < e.ne; i++) {
+        part_emit_gen(&e.emits[i]);
+    }
+    
+    PROF_END();
+}
+
+// Record a snapshot of the live particles
+void part_drw(void)
+{
+    if (!e.np) return;
+    PROF_BEG("part_drw");
+    rcmd* c = rnd_add(RC_PARTS);
+    if (c) {
+        c->p = rnd_dup(e.parts, e.np * sizeof(part));
+        c->n = c->p ? e.np : 0;
+    }
+    PROF_END();
+}
+
+void part_clear(void)
+{
+    e.np = 0;
+    e.ne = 0;
+}
+
+// Resource functions implementation
+static void res_free_data(u8 type, void* data)
+{
+    if (!data) return;
+    if (type == RES_SND) {
+        snd* s = (snd*)data;
+        if (!s->mapped) free(s->data);
+    } else if (type == RES_TEX) {
+        tex* t = (tex*)data;
+        if (!t->mapped) free(t->data);
+        free(t->path);
+    } else if (type == RES_FONT) {
+        font* f = (font*)data;
+        if (!f->mapped && f->num_chars) {
+            free(f->chars[0].data); // Glyph block
+        }
+        free(f->chars);
+        tex_free(f->id);
+    } else if (type == RES_PAK) {
+        pak* p = (pak*)data;
+        munmap(p->base, p->size);
+    } else if (type == RES_MUS) {
+        mus* m = (mus*)data;
+        munmap(m->base, m->size);
+    }
+    free(data);
+}
+
+static char* str_dup(const char* str)
+{
+    size_t len = strlen(str) + 1;
+    char* p = mem_alloc(len);
+    if (p) memcpy(p, str, len);
+    return p;
+}
+
+// FNV-1a
+static u32 res_hash(const char* key)
+{
+    u32 h = 2166136261u;
+    while (*key) {
+        h = (h ^ (u8)*key++) * 16777619u;
+    }
+    return h;
+}
+
+static s64 file_mtime(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) return -1;
+    return (s64)st.st_mtime;
+}
+
+static void res_uncache(res* r)
+{
+    if (!r->key) return;
+    
+    u32* link = &e.rm.cache[res_hash(r->key) % RES_BUCKETS];
+    while (*link) {
+        res* c = &e.rm.ress[hnd_idx(&e.rm.hp, *link)];
+        if (c == r) {
+            *link = r->next;
+            break;
+        }
+        link = &c->next;
+    }
+    free(r->key);
+    r->key = NULL;
+    r->next = 0;
+}
+
+// Look up a cached resource and take a reference; a changed mtime evicts
+// the old entry from the cache (existing users keep it alive)
+static u32 res_cache_get(u8 type, const char* key, s64 mtime)
+{
+    u32 id = e.rm.cache[res_hash(key) % RES_BUCKETS];
+    while (id) {
+        res* r = &e.rm.ress[hnd_idx(&e.rm.hp, id)];
+        if (r->type == type && strcmp(r->key, key) == 0) {
+            if (r->mtime != mtime) {
+                res_uncache(r);
+                return 0;
+            }
+            r->refs++;
+            return id;
+        }
+        id = r->next;
+    }
+    return 0;
+}
+
+static void res_cache_put(u32 id, const char* key, s64 mtime)
+{
+    u32 d = hnd_idx(&e.rm.hp, id);
+    if (d == HND_NONE) return;
+    
+    res* r = &e.rm.ress[d];
+    r->key = str_dup(key);
+    if (!r->key) return;
+    r->mtime = mtime;
+    
+    u32* head = &e.rm.cache[res_hash(key) % RES_BUCKETS];
+    r->next = *head;
+    *head = id;
+}
+
+// Bytes a resource holds in process memory (pack mappings are file-backed)
+static u32 res_size(u8 type, void* data)
+{
+    if (!data) return 0;
+    switch (type) {
+        case RES_SPR: return sizeof(spr);
+        case RES_TEX: {
+            tex* t = (tex*)data;
+            return sizeof(tex) + (t->mapped || !t->data ? 0 : t->w * t->h * sizeof(col));
+        }
+        case RES_FONT: {
+            font* f = (font*)data;
+            return sizeof(font) + f->num_chars * sizeof(font_char) +
+                   (f->mapped ? 0 : f->num_chars * f->cw * f->ch);
+        }
+        case RES_SND: {
+            snd* s = (snd*)data;
+            return sizeof(snd) + (s->mapped ? 0 : s->len * s->ch * sizeof(s16));
+        }
+        case RES_PAK: return sizeof(pak);
+        case RES_MUS: return sizeof(mus);
+        default: return 0;
+    }
+}
+
+// Re-measure a resource after its data changed and check the budget
+static void res_account(u32 id)
+{
+    u32 d = hnd_idx(&e.rm.hp, id);
+    if (d == HND_NONE) return;
+    
+    res* r = &e.rm.ress[d];
+    u32 sz = res_size(r->type, r->data);
+    e.rm.bytes[r->type % RES_TYPES] += (s64)sz - r->sz;
+    e.rm.total += (s64)sz - r->sz;
+    u8 grew = sz > r->sz;
+    r->sz = sz;
+    
+    // Make room under the texture residency cap
+    if (grew && r->type == RES_TEX) tex_trim(id);
+    
+    if (e.rm.budget && e.rm.total > e.rm.budget) {
+        if (!e.rm.over && e.rm.warn) e.rm.warn(e.rm.total, e.rm.budget);
+        e.rm.over = 1;
+    } else {
+        e.rm.over = 0;
+    }
+}
+
+u32 res_add(void* data, u8 type, const char* name)
+{
+    u32 cap = e.rm.hp.cap;
+    u32 h = hnd_new(&e.rm.hp);
+    if (!h) return 0;
+    
+    // Dense storage grows with the pool
+    if (e.rm.hp.cap != cap) {
+        res* ress = mem_realloc(e.rm.ress, e.rm.hp.cap * sizeof(res));
+        if (!ress) {
+            hnd_del(&e.rm.hp, h);
+            return 0;
+        }
+        e.rm.ress = ress;
+    }
+    
+    res* r = &e.rm.ress[e.rm.hp.n - 1];
+    r->id = h;
+    r->type = type;
+    r->data = data;
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = '\0';
+    r->refs = 1;
+    r->key = NULL;
+    r->mtime = 0;
+    r->next = 0;
+    r->sz = 0;
+    
+    e.rm.nr = e.rm.hp.n;
+    e.rm.next_id++;
+    res_account(h);
+    return h;
+}
+
+void* res_get(u32 id)
+{
+    u32 d = hnd_idx(&e.rm.hp, id);
+    return d == HND_NONE ? NULL : e.rm.ress[d].data;
+}
+
+void* res_find(const char* name)
+{
+    for (u32 i = 0; i < e.rm.nr; i++) {
+        if (strcmp(e.rm.ress[i].name, name) == 0) {
+            return e.rm.ress[i].data;
+        }
+    }
+    return NULL;
+}
+
+void res_retain(u32 id)
+{
+    u32 d = hnd_idx(&e.rm.hp, id);
+    if (d != HND_NONE) e.rm.ress[d].refs++;
+}
+
+// Drop a reference; the resource is freed with the last one
+void res_release(u32 id)
+{
+    u32 d = hnd_idx(&e.rm.hp, id);
+    if (d == HND_NONE) return;
+    if (--e.rm.ress[d].refs == 0) res_del(id);
+}
+
+void res_del(u32 id)
+{
+    u32 d = hnd_idx(&e.rm.hp, id);
+    if (d == HND_NONE) return;
+    res_uncache(&e.rm.ress[d]);
+    e.rm.bytes[e.rm.ress[d].type % RES_TYPES] -= e.rm.ress[d].sz;
+    e.rm.total -= e.rm.ress[d].sz;
+    if (e.rm.total <= e.rm.budget) e.rm.over = 0;
+    
+    // Unlink first: freeing a font releases its texture, which moves entries
+    res r = e.rm.ress[d];
+    hnd_del(&e.rm.hp, id);
+    if (d < e.rm.hp.n) e.rm.ress[d] = e.rm.ress[e.rm.hp.n];
+    e.rm.nr = e.rm.hp.n;
+    
+    res_free_data(r.type, r.data);
+}
+
+void res_clear(void)
+{
+    while (e.rm.nr > 0) {
+        res_del(e.rm.ress[e.rm.nr - 1].id);
+    }
+    free(e.rm.ress);
+    e.rm.ress = NULL;
+    hnd_free(&e.rm.hp);
+    memset(e.rm.cache, 0, sizeof(e.rm.cache));
+    memset(e.rm.bytes, 0, sizeof(e.rm.bytes));
+    e.rm.total = 0;
+    e.rm.over = 0;
+    e.rm.nr = 0;
+    e.rm.next_id = 1;
+}
+
+// Set the memory budget for resource data (0 = unlimited)
+void res_budget(u64 bytes, res_warn_fn warn)
+{
+    e.rm.budget = bytes;
+    e.rm.warn = warn;
+    e.rm.over = 0;
+    if (bytes && e.rm.total > bytes) {
+        if (warn) warn(e.rm.total, bytes);
+        e.rm.over = 1;
+    }
+}
+
+// Bytes held by one resource type, or by all of them for type 0
+u64 res_bytes(u8 type)
+{
+    return type ? e.rm.bytes[type % RES_TYPES] : e.rm.total;
+}
+
+static u32 res_sz(u32 id)
+{
+    u32 d = hnd_idx(&e.rm.hp, id);
+    return d == HND_NONE ? 0 : e.rm.ress[d].sz;
+}
+
+// Fill ids with up to n of the largest resources, biggest first
+u32 res_top(u32* ids, u32 n)
+{
+    u32 k = 0;
+    if (!n) return 0;
+    
+    for (u32 i = 0; i < e.rm.nr; i++) {
+        res* r = &e.rm.ress[i];
+        if (k == n && r->sz <= res_sz(ids[n - 1])) continue;
+        
+        // Insert into the sorted prefix, dropping the smallest when full
+        u32 j = k < n ? k++ : n - 1;
+        while (j > 0 && res_sz(ids[j - 1]) < r->sz) {
+            ids[j] = ids[j - 1];
+            j--;
+        }
+        ids[j] = r->id;
+    }
+    return k;
+}
+
+// Budget warning that lists the largest resources
+void res_warn_top(u64 used, u64 budget)
+{
+    u32 ids[5];
+    u32 n = res_top(ids, 5);
+    fprintf(stderr, "Resource budget exceeded: %llu KB of %llu KB\n",
+            (unsigned long long)(used / 1024), (unsigned long long)(budget / 1024));
+    for (u32 i = 0; i < n; i++) {
+        const res* r = &e.rm.ress[hnd_idx(&e.rm.hp, ids[i])];
+        fprintf(stderr, "  %-16s %u KB\n", r->name, r->sz / 1024);
+    }
+}
+
+// Synth functions implementation
+#define AUD_RATE 44100
+#define SYN_TAB 1024 // sine wavetable size, power of two
+
+static f32 syn_sin_tab[SYN_TAB + 1]; // one guard entry for interpolation
+static pthread_once_t syn_once = PTHREAD_ONCE_INIT;
+
+static void syn_tab_ini(void)
+{
+    for (u32 i = 0; i <= SYN_TAB; i++) {
+        syn_sin_tab[i] = (f32)sin(2.0 * M_PI * i / SYN_TAB);
+    }
+}
+
+// PolyBLEP residual, smooths the step at t = 0 (t and dt in turns)
+static f32 syn_blep(f32 t, f32 dt)
+{
+    if (t < dt) {
+        t /= dt;
+        return t + t - t * t - 1.0f;
+    }
+    if (t > 1.0f - dt) {
+        t = (t - 1.0f) / dt;
+        return t * t + t + t + 1.0f;
+    }
+    return 0.0f;
+}
+
+void syn_start(syn_st* st, const syn* p, u32 ms, u32 rate)
+{
+    pthread_once(&syn_once, syn_tab_ini);
+    
+    st->p = *p;
+    st->pos = 0;
+    st->len = (u32)((u64)rate * ms / 1000);
+    st->phase = 0;
+    st->inc = p->hz / rate * 4294967296.0f;
+    f32 end = p->hz_end > 0.0f ? p->hz_end / rate * 4294967296.0f : st->inc;
+    st->dinc = st->len ? (end - st->inc) / st->len : 0.0f;
+    st->rng = 0x9E3779B9u;
+    st->atk = (u32)(p->atk * rate);
+    st->dec = (u32)(p->dec * rate);
+    st->rel = (u32)(p->rel * rate);
+}
+
+// Render up to n samples; returns how many were written (0 when done)
+u32 syn_gen(syn_st* st, s16* out, u32 n)
+{
+    if (n > st->len - st->pos) n = st->len - st->pos;
+    
+    const f32 turn = 1.0f / 4294967296.0f;
+    const f32 scale = st->p.amp * 32767.0f;
+    u32 rel_at = st->len > st->rel ? st->len - st->rel : 0;
+    
+    for (u32 i = 0; i < n; i++, st->pos++) {
+        // ADSR level, release runs over the last rel samples
+        u32 k = st->pos;
+        f32 env;
+        if (k < st->atk) env = (f32)k / st->atk;
+        else if (k - st->atk < st->dec) env = 1.0f - (1.0f - st->p.sus) * (k - st->atk) / st->dec;
+        else env = st->p.sus;
+        if (k >= rel_at && st->rel) env *= (f32)(st->len - k) / st->rel;
+        
+        f32 t = st->phase * turn;
+        f32 dt = st->inc * turn;
+        f32 x;
+        switch (st->p.wave) {
+            case SYN_SIN: {
+                u32 idx = st->phase >> (32 - 10);
+                f32 frac = (st->phase & ((1u << 22) - 1)) * (1.0f / (1u << 22));
+                x = syn_sin_tab[idx] + (syn_sin_tab[idx + 1] - syn_sin_tab[idx]) * frac;
+                break;
+            }
+            case SYN_SQR: {
+                f32 t2 = t + 0.5f;
+                if (t2 >= 1.0f) t2 -= 1.0f;
+                x = (t < 0.5f ? 1.0f : -1.0f) + syn_blep(t, dt) - syn_blep(t2, dt);
+                break;
+            }
+            case SYN_SAW:
+                x = 2.0f * t - 1.0f - syn_blep(t, dt);
+                break;
+            case SYN_TRI:
+                x = 4.0f * (t < 0.5f ? t : 1.0f - t) - 1.0f;
+                break;
+            case SYN_NOISE:
+                st->rng ^= st->rng << 13;
+                st->rng ^= st->rng >> 17;
+                st->rng ^= st->rng << 5;
+                x = (s32)st->rng * (1.0f / 2147483648.0f);
+                break;
+            default:
+                x = 0.0f;
+        }
+        
+        out[i] = (s16)(x * env * scale);
+        st->phase += (u32)st->inc;
+        st->inc += st->dinc;
+    }
+    return n;
+}
+
+// Render a patch into a new mono sound resource
+u32 snd_syn(const syn* p, u32 ms, const char* name)
+{
+    syn_st st;
+    syn_start(&st, p, ms, AUD_RATE);
+    
+    snd* s = mem_alloc(sizeof(snd));
+    if (!s) return 0;
+    s->data = mem_alloc(st.len * sizeof(s16));
+    if (!s->data) {
+        free(s);
+        return 0;
+    }
+    s->len = syn_gen(&st, s->data, st.len);
+    s->rate = AUD_RATE;
+    s->ch = 1;
+    s->id = 0;
+    s->mapped = 0;
+    
+    return res_add(s, RES_SND, name);
+}
+
+// Audio functions implementation
+// The audio thread owns the PCM device and mixes voices period by period;
+// aud_play only posts a command into a lock-free SPSC ring
+#define AUD_PERIOD 256  // frames per mix period (~5.8 ms)
+#define AUD_VOICES 16
+#define AUD_CMDS 64     // command ring size, power of two
+
+// Mixing kernels; all produce bit-identical results
+static void mix_scalar(s32* l, s32* r, const s16* src, u32 n, s32 gl, s32 gr)
+{
+    for (u32 i = 0; i < n; i++) {
+        l[i] += (src[i] * gl) >> 15;
+        r[i] += (src[i] * gr) >> 15;
+    }
+}
+
+#if X86_SIMD
+// 8 samples per step: 16x16 -> 32-bit products from mullo/mulhi pairs
+__attribute__((target("sse2")))
+static void mix_sse2(s32* l, s32* r, const s16* src, u32 n, s32 gl, s32 gr)
+{
+    const __m128i vgl = _mm_set1_epi16((s16)gl);
+    const __m128i vgr = _mm_set1_epi16((s16)gr);
+    u32 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+        
+        __m128i lo = _mm_mullo_epi16(x, vgl);
+        __m128i hi = _mm_mulhi_epi16(x, vgl);
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+        _mm_storeu_si128((__m128i*)(l + i), _mm_add_epi32(_mm_loadu_si128((__m128i*)(l + i)), a));
+        _mm_storeu_si128((__m128i*)(l + i + 4), _mm_add_epi32(_mm_loadu_si128((__m128i*)(l + i + 4)), b));
+        
+        lo = _mm_mullo_epi16(x, vgr);
+        hi = _mm_mulhi_epi16(x, vgr);
+        a = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+        b = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+        _mm_storeu_si128((__m128i*)(r + i), _mm_add_epi32(_mm_loadu_si128((__m128i*)(r + i)), a));
+        _mm_storeu_si128((__m128i*)(r + i + 4), _mm_add_epi32(_mm_loadu_si128((__m128i*)(r + i + 4)), b));
+    }
+    mix_scalar(l + i, r + i, src + i, n - i, gl, gr);
+}
+
+// 8 samples per step, widened to 32 bits before the multiply
+__attribute__((target("avx2")))
+static void mix_avx2(s32* l, s32* r, const s16* src, u32 n, s32 gl, s32 gr)
+{
+    const __m256i vgl = _mm256_set1_epi32(gl);
+    const __m256i vgr = _mm256_set1_epi32(gr);
+    u32 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i a = _mm256_srai_epi32(_mm256_mullo_epi32(x, vgl), 15);
+        __m256i b = _mm256_srai_epi32(_mm256_mullo_epi32(x, vgr), 15);
+        _mm256_storeu_si256((__m256i*)(l + i), _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(l + i)), a));
+        _mm256_storeu_si256((__m256i*)(r + i), _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(r + i)), b));
+    }
+    mix_scalar(l + i, r + i, src + i, n - i, gl, gr);
+}
+#endif
+
+// Kernel for the given MIX_* kind, NULL if the CPU lacks it
+mix_fn mix_get(u8 kind)
+{
+    switch (kind) {
+        case MIX_SCALAR: return mix_scalar;
+#if X86_SIMD
+        case MIX_SSE2: return __builtin_cpu_supports("sse2") ? mix_sse2 : NULL;
+        case MIX_AVX2: return __builtin_cpu_supports("avx2") ? mix_avx2 : NULL;
+#endif
+        default: return NULL;
+    }
+}
+
+// Saturate planar accumulators to interleaved stereo s16
+void mix_out(s16* out, const s32* l, const s32* r, u32 n)
+{
+    u32 i = 0;
+#if X86_SIMD
+    for (; i + 8 <= n; i += 8) {
+        __m128i lp = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(l + i)),
+                                     _mm_loadu_si128((const __m128i*)(l + i + 4)));
+        __m128i rp = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(r + i)),
+                                     _mm_loadu_si128((const __m128i*)(r + i + 4)));
+        _mm_storeu_si128((__m128i*)(out + i * 2), _mm_unpacklo_epi16(lp, rp));
+        _mm_storeu_si128((__m128i*)(out + i * 2 + 8), _mm_unpackhi_epi16(lp, rp));
+    }
+#endif
+    for (; i < n; i++) {
+        s32 a = l[i], b = r[i];
+        out[i * 2] = a > 32767 ? 32767 : a < -32768 ? -32768 : a;
+        out[i * 2 + 1] = b > 32767 ? 32767 : b < -32768 ? -32768 : b;
+    }
+}
+
+typedef struct {
+    const snd* s;   // sample data, or NULL
+    u32 pos;
+    s32 gl, gr;     // Q15 channel gains
+    u8 live;        // synthesized on the audio thread
+    syn_st syn;
+    const mus* m;   // streamed music, or NULL
+    u32 win;        // read-ahead window the stream is in
+    u8 stop;        // command: stop voices streaming m
+    u64 trig;       // aud_play time (ns), 0 once measured
+} aud_voice;
+
+static pthread_t aud_thr;
+static u8 aud_quit;
+static aud_voice aud_q[AUD_CMDS]; // play commands (pos unused)
+static u32 aud_qw;  // written by the main thread
+static u32 aud_qr;  // written by the audio thread
+static aud_voice aud_v[AUD_VOICES];
+static const snd* aud_snds[3]; // SND_JUMP..SND_CLICK
+static mix_fn aud_kern;
+static aud_stats aud_st;
+
+// Audio output backend; write blocks at the output's real-time rate
+typedef struct {
+    u8 kind;
+    int (*open)(const char* path);
+    int (*write)(const s16* buf, u32 frames); // <0 on error, 1 on underrun
+    u32 (*delay)(void);                        // frames queued ahead of output
+    void (*close)(void);
+} aud_out;
+
+static u8 aud_kind = AUD_ALSA;
+static const char* aud_path = "out.wav";
+static const aud_out* aud_dev;
+
+// ALSA output
+static int alsa_open(const char* path)
+{
+    (void)path;
+    int err = snd_pcm_open((snd_pcm_t**)&e.ahan, "default", SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        fprintf(stderr, "Audio open error: %s\n", snd_strerror(err));
+        return -1;
+    }
+    
+    // Set parameters (stereo, short buffer, the mixer keeps it topped up)
+    err = snd_pcm_set_params((snd_pcm_t*)e.ahan,
+                            SND_PCM_FORMAT_S16_LE,
+                            SND_PCM_ACCESS_RW_INTERLEAVED,
+                            2, AUD_RATE, 1, 20000);
+    if (err < 0) {
+        fprintf(stderr, "Audio set params error: %s\n", snd_strerror(err));
+        snd_pcm_close((snd_pcm_t*)e.ahan);
+        return -1;
+    }
+    return 0;
+}
+
+static int alsa_write(const s16* buf, u32 frames)
+{
+    int err = snd_pcm_writei((snd_pcm_t*)e.ahan, buf, frames);
+    if (err == -EPIPE) {
+        snd_pcm_recover((snd_pcm_t*)e.ahan, err, 1);
+        return 1;
+    }
+    if (err < 0) {
+        return snd_pcm_recover((snd_pcm_t*)e.ahan, err, 1) < 0 ? -1 : 0;
+    }
+    return 0;
+}
+
+static u32 alsa_delay(void)
+{
+    snd_pcm_sframes_t d;
+    if (snd_pcm_delay((snd_pcm_t*)e.ahan, &d) < 0 || d < 0) return 0;
+    return (u32)d;
+}
+
+static void alsa_close(void)
+{
+    snd_pcm_drop((snd_pcm_t*)e.ahan);
+    snd_pcm_close((snd_pcm_t*)e.ahan);
+}
+
+// Null output: consumes frames at the real-time rate through a simulated
+// 20 ms buffer, so pacing and underruns behave like a device
+#define NUL_BUF (AUD_RATE / 50)
+
+static u64 nul_t0;      // time frame 0 played
+static u64 nul_frames;  // frames written
+
+static u64 nul_played(u64 now)
+{
+    return (now - nul_t0) * AUD_RATE / 1000000000u;
+}
+
+static int nul_open(const char* path)
+{
+    (void)path;
+    nul_t0 = tm_ns();
+    nul_frames = 0;
+    return 0;
+}
+
+static int nul_write(const s16* buf, u32 frames)
+{
+    (void)buf;
+    u64 now = tm_ns();
+    int under = 0;
+    
+    // Buffer ran dry: restart the clock from now
+    if (nul_played(now) > nul_frames) {
+        nul_t0 = now - nul_frames * 1000000000u / AUD_RATE;
+        under = nul_frames > 0;
+    }
+    nul_frames += frames;
+    
+    // Block until the buffer has room for the next period
+    if (nul_frames > NUL_BUF) {
+        u64 t = nul_t0 + (nul_frames - NUL_BUF) * 1000000000u / AUD_RATE;
+        if (t > now) {
+            struct timespec ts = {(time_t)(t / 1000000000u), (long)(t % 1000000000u)};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+    }
+    return under;
+}
+
+static u32 nul_delay(void)
+{
+    u64 played = nul_played(tm_ns());
+    return played < nul_frames ? (u32)(nul_frames - played) : 0;
+}
+
+static void nul_close(void)
+{
+}
+
+// WAV output: the null output's pacing, plus a 16-bit stereo PCM file
+static FILE* wav_f;
+static u32 wav_bytes;
+
+static void wav_hdr(FILE* f, u32 bytes)
+{
+    u32 v;
+    u16 h;
+    fwrite("RIFF", 1, 4, f);
+    v = 36 + bytes; fwrite(&v, 4, 1, f);
+    fwrite("WAVEfmt ", 1, 8, f);
+    v = 16; fwrite(&v, 4, 1, f);
+    h = 1; fwrite(&h, 2, 1, f);              // PCM
+    h = 2; fwrite(&h, 2, 1, f);              // channels
+    v = AUD_RATE; fwrite(&v, 4, 1, f);
+    v = AUD_RATE * 4; fwrite(&v, 4, 1, f);   // byte rate
+    h = 4; fwrite(&h, 2, 1, f);              // block align
+    h = 16; fwrite(&h, 2, 1, f);             // bits
+    fwrite("data", 1, 4, f);
+    fwrite(&bytes, 4, 1, f);
+}
+
+static int wav_open(const char* path)
+{
+    wav_f = fopen(path, "wb");
+    if (!wav_f) {
+        fprintf(stderr, "Audio open error: %s\n", path);
+        return -1;
+    }
+    wav_bytes = 0;
+    wav_hdr(wav_f, 0);
+    return nul_open(path);
+}
+
+static int wav_write(const s16* buf, u32 frames)
+{
+    wav_bytes += fwrite(buf, 4, frames, wav_f) * 4;
+    return nul_write(buf, frames);
+}
+
+static void wav_close(void)
+{
+    // Patch sizes now that the length is known
+    fseek(wav_f, 0, SEEK_SET);
+    wav_hdr(wav_f, wav_bytes);
+    fclose(wav_f);
+    wav_f = NULL;
+}
+
+static const aud_out aud_outs[] = {
+    {AUD_ALSA, alsa_open, alsa_write, alsa_delay, alsa_close},
+    {AUD_NULL, nul_open, nul_write, nul_delay, nul_close},
+    {AUD_WAV, wav_open, wav_write, nul_delay, wav_close},
+};
+
+// Samples a voice has left to play
+static u32 aud_left(const aud_voice* v)
+{
+    if (v->live) return v->syn.len - v->syn.pos;
+    if (v->m) return v->m->loop_end ? 0xFFFFFFFFu : v->m->len - v->pos;
+    return v->s ? v->s->len - v->pos : 0;
+}
+
+// Start a voice, stealing the one closest to its end when all are busy
+static void aud_start(const aud_voice* c)
+{
+    aud_voice* v = NULL;
+    for (u32 i = 0; i < AUD_VOICES; i++) {
+        if (!aud_left(&aud_v[i])) {
+            v = &aud_v[i];
+            break;
+        }
+        if (!v || aud_left(&aud_v[i]) < aud_left(v)) v = &aud_v[i];
+    }
+    *v = *c;
+    v->pos = 0;
+    v->win = 0xFFFFFFFFu;
+    __atomic_store_n(&aud_st.plays, aud_st.plays + 1, __ATOMIC_RELAXED);
+}
+
+// Add m frames of a mono or interleaved source to the accumulators
+static void aud_src(s32* accl, s32* accr, const s16* src, u32 ch, u32 m, s32 gl, s32 gr)
+{
+    if (ch == 1) {
+        aud_kern(accl, accr, src, m, gl, gr);
+    } else {
+        // Interleaved sources use their first two channels
+        for (u32 j = 0; j < m; j++) {
+            accl[j] += (src[j * ch] * gl) >> 15;
+            accr[j] += (src[j * ch + 1] * gr) >> 15;
+        }
+    }
+}
+
+// Read-ahead window (frames); about two windows of a track stay resident
+#define MUS_WIN (AUD_RATE / 2)
+
+// Advise the kernel about frames [beg, beg + n) of a track
+static void mus_advise(const mus* m, u32 beg, u32 n, int advice)
 {
-    part_emit e;
-    e.pos = pos;
-    e.vel_range = vel_range;
-    e.life_range = life_range;
-    e.type = type;
-    e.active = 1;
-    e.rate = rate;
-    e.count = 0;
-    return e;
+    if (beg >= m->len) return;
+    if (n > m->len - beg) n = m->len - beg;
+    u32 hdr = (const u8*)m->data - m->base;
+    u32 a = (hdr + beg * m->ch * sizeof(s16)) & ~(u32)(sysconf(_SC_PAGESIZE) - 1);
+    u32 b = hdr + (beg + n) * m->ch * sizeof(s16);
+    madvise(m->base + a, b - a, advice);
 }
 
-void part_emit_gen(part_emit* e)
+// Stream one period, wrapping at the loop points. On entering a new
+// window the next one is prefetched and the last one dropped, so the
+// device never waits on disk and memory stays flat with track length
+static void aud_mus(aud_voice* v, s32* accl, s32* accr, u32 n)
 {
-    if (!e->active) return;
+    const mus* m = v->m;
+    u32 done = 0;
+    while (done < n) {
+        u32 end = m->loop_end ? m->loop_end : m->len;
+        if (v->pos >= end) {
+            if (!m->loop_end) {
+                v->m = NULL;
+                return;
+            }
+            v->pos = m->loop_beg;
+        }
+        u32 k = end - v->pos;
+        if (k > n - done) k = n - done;
+        aud_src(accl + done, accr + done, m->data + (size_t)v->pos * m->ch, m->ch, k, v->gl, v->gr);
+        v->pos += k;
+        done += k;
+    }
     
-    e->count++;
-    if (e->count >= e->rate) {
-        e->count = 0;
+    u32 w = v->pos / MUS_WIN;
+    if (w == v->win) return;
+    if (v->win != 0xFFFFFFFFu) mus_advise(m, v->win * MUS_WIN, MUS_WIN, MADV_DONTNEED);
+    u32 next = (w + 1) * MUS_WIN;
+    if (m->loop_end && next >= m->loop_end) next = m->loop_beg;
+    mus_advise(m, next, MUS_WIN, MADV_WILLNEED);
+    v->win = w;
+}
+
+// Mix all active voices into interleaved stereo out, saturating to s16
+static void aud_mix(s16* out, u32 n)
+{
+    s32 accl[AUD_PERIOD], accr[AUD_PERIOD];
+    memset(accl, 0, n * sizeof(s32));
+    memset(accr, 0, n * sizeof(s32));
+    
+    for (u32 i = 0; i < AUD_VOICES; i++) {
+        aud_voice* v = &aud_v[i];
         
-        // Generate random velocity within range
-        v2 vel = v2_mk(
-            ((f32)rand() / RAND_MAX) * e->vel_range.x * 2 - e->vel_range.x,
-            ((f32)rand() / RAND_MAX) * e->vel_range.y * 2 - e->vel_range.y
-        );
+        // Live voices render one period at a time
+        if (v->live) {
+            s16 tmp[AUD_PERIOD];
+            u32 m = syn_gen(&v->syn, tmp, n);
+            aud_kern(accl, accr, tmp, m, v->gl, v->gr);
+            if (m < n) v->live = 0;
+            continue;
+        }
+        if (v->m) {
+            aud_mus(v, accl, accr, n);
+            continue;
+        }
+        if (!v->s) continue;
         
-        // Generate random life within range
-        f32 life = ((f32)rand() / RAND_MAX) * e->life_range;
+        u32 m = v->s->len - v->pos;
+        if (m > n) m = n;
+        aud_src(accl, accr, v->s->data + (size_t)v->pos * v->s->ch, v->s->ch, m, v->gl, v->gr);
+        v->pos += m;
+        if (v->pos >= v->s->len) v->s = NULL;
+    }
+    
+    mix_out(out, accl, accr, n);
+}
+
+static void* aud_main(void* arg)
+{
+    (void)arg;
+    s16 buf[AUD_PERIOD * 2];
+    PROF_THREAD("audio");
+    
+    while (!__atomic_load_n(&aud_quit, __ATOMIC_ACQUIRE)) {
+        u64 t0 = tm_ns();
         
-        // Set color based on type
-        col clr;
-        switch (e->type) {
-            case PART_DUST:
-                clr = (col){200, 200, 200}; // Gray
-                break;
-            case PART_SPARK:
-                clr = (col){255, 255, 100}; // Yellow
-                break;
-            case PART_SMOKE:
-                clr = (col){100, 100, 100}; // Dark gray
-                break;
-            default:
-                clr = (col){255, 255, 255}; // White
+        // Drain play commands
+        u32 r = aud_qr;
+        u32 w = __atomic_load_n(&aud_qw, __ATOMIC_ACQUIRE);
+        while (r != w) {
+            const aud_voice* c = &aud_q[r & (AUD_CMDS - 1)];
+            if (c->stop) {
+                for (u32 i = 0; i < AUD_VOICES; i++) {
+                    if (aud_v[i].m == c->m) aud_v[i].m = NULL;
+                }
+            } else {
+                aud_start(c);
+            }
+            r++;
         }
+        __atomic_store_n(&aud_qr, r, __ATOMIC_RELEASE);
         
-        part_add(e->pos, vel, clr, life, e->type);
+        // Silence keeps the output running at a constant latency
+        PROF_BEG("aud_mix");
+        aud_mix(buf, AUD_PERIOD);
+        PROF_END();
+        u64 t1 = tm_ns();
+        
+        // New voices reach the output once the queued frames have played
+        u64 out = t1 + (u64)aud_dev->delay() * 1000000000u / AUD_RATE;
+        for (u32 i = 0; i < AUD_VOICES; i++) {
+            aud_voice* v = &aud_v[i];
+            if (!v->trig) continue;
+            u32 lat = out > v->trig ? (u32)(out - v->trig) : 0;
+            __atomic_store_n(&aud_st.lat_ns, lat, __ATOMIC_RELAXED);
+            if (lat > aud_st.lat_ns_max) __atomic_store_n(&aud_st.lat_ns_max, lat, __ATOMIC_RELAXED);
+            __atomic_store_n(&aud_st.lat_ns_sum, aud_st.lat_ns_sum + lat, __ATOMIC_RELAXED);
+            v->trig = 0;
+        }
+        
+        u32 mix = (u32)(t1 - t0);
+        __atomic_store_n(&aud_st.mix_ns, mix, __ATOMIC_RELAXED);
+        if (mix > aud_st.mix_ns_max) __atomic_store_n(&aud_st.mix_ns_max, mix, __ATOMIC_RELAXED);
+        __atomic_store_n(&aud_st.mix_ns_sum, aud_st.mix_ns_sum + mix, __ATOMIC_RELAXED);
+        
+        // The blocking write paces this loop
+        int err = aud_dev->write(buf, AUD_PERIOD);
+        if (err > 0) __atomic_store_n(&aud_st.underruns, aud_st.underruns + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&aud_st.periods, aud_st.periods + 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Select the audio output before ini(); path is used by AUD_WAV
+void aud_use(u8 out, const char* path)
+{
+    aud_kind = out;
+    if (path) aud_path = path;
+}
+
+void aud_ini(void)
+{
+    // Open the chosen output; ALSA falls back to the null output so the
+    // mixer keeps running (and measurable) without sound hardware
+    aud_dev = NULL;
+    for (u32 i = 0; i < sizeof(aud_outs) / sizeof(aud_outs[0]); i++) {
+        if (aud_outs[i].kind == aud_kind) aud_dev = &aud_outs[i];
+    }
+    if (!aud_dev || aud_dev->open(aud_path) < 0) {
+        if (aud_kind != AUD_ALSA) {
+            e.aud = 0;
+            return;
+        }
+        aud_dev = &aud_outs[1];
+        aud_dev->open(aud_path);
+        printf("Audio falling back to null output\n");
+    }
+    
+    // Synthesize sound effects and add to resource manager
+    const syn jump = {SYN_SIN, 440, 660, 0.1f, 0.005f, 0.05f, 0.7f, 0.05f};
+    const syn hit = {SYN_SQR, 220, 0, 0.25f, 0.002f, 0.03f, 0.6f, 0.03f};
+    const syn click = {SYN_SQR, 880, 0, 0.25f, 0.001f, 0.01f, 0.5f, 0.01f};
+    
+    // Resolve sound codes once
+    aud_snds[SND_JUMP - 1] = snd_get(snd_syn(&jump, 200, "jump"));
+    aud_snds[SND_HIT - 1] = snd_get(snd_syn(&hit, 100, "hit"));
+    aud_snds[SND_CLICK - 1] = snd_get(snd_syn(&click, 50, "click"));
+    
+    // Pick the widest mixing kernel the CPU supports
+    aud_kern = mix_get(MIX_AVX2);
+    if (!aud_kern) aud_kern = mix_get(MIX_SSE2);
+    if (!aud_kern) aud_kern = mix_get(MIX_SCALAR);
+    
+    // Start mixer thread
+    memset(aud_v, 0, sizeof(aud_v));
+    memset(&aud_st, 0, sizeof(aud_st));
+    aud_st.out = aud_dev->kind;
+    aud_qw = aud_qr = 0;
+    aud_quit = 0;
+    if (pthread_create(&aud_thr, NULL, aud_main, NULL) != 0) {
+        fprintf(stderr, "Audio thread error\n");
+        aud_dev->close();
+        e.aud = 0;
+        return;
+    }
+    
+    e.aud = 1;
+    printf("Audio initialized\n");
+}
+
+// Linear pan law, Q15 gains
+static void aud_gains(aud_voice* c, f32 gain, f32 pan)
+{
+    if (gain < 0.0f) gain = 0.0f;
+    if (gain > 1.0f) gain = 1.0f;
+    if (pan < -1.0f) pan = -1.0f;
+    if (pan > 1.0f) pan = 1.0f;
+    f32 l = pan > 0.0f ? 1.0f - pan : 1.0f;
+    f32 r = pan < 0.0f ? 1.0f + pan : 1.0f;
+    c->gl = (s32)(gain * l * 32767.0f);
+    c->gr = (s32)(gain * r * 32767.0f);
+}
+
+void aud_play(u8 s)
+{
+    aud_play_ex(s, 1.0f, 0.0f);
+}
+
+// Play with gain (0..1) and pan (-1 left .. 1 right). Never blocks; the
+// sound is dropped if the command ring is full
+void aud_play_ex(u8 s, f32 gain, f32 pan)
+{
+    if (!e.aud) return;
+    if (s < SND_JUMP || s > SND_CLICK) return;
+    
+    const snd* sound = aud_snds[s - SND_JUMP];
+    if (!sound || !sound->data || !sound->len) return;
+    
+    PROF_BEG("aud_play");
+    u32 w = aud_qw;
+    if (w - __atomic_load_n(&aud_qr, __ATOMIC_ACQUIRE) != AUD_CMDS) {
+        aud_voice* c = &aud_q[w & (AUD_CMDS - 1)];
+        c->s = sound;
+        c->pos = 0;
+        aud_gains(c, gain, pan);
+        c->live = 0;
+        c->m = NULL;
+        c->stop = 0;
+        c->trig = tm_ns();
+        __atomic_store_n(&aud_qw, w + 1, __ATOMIC_RELEASE);
+    }
+    PROF_END();
+}
+
+// Synthesize a patch on the audio thread; nothing is allocated or
+// pre-rendered, so effects can be made up on the fly
+void aud_play_syn(const syn* p, u32 ms, f32 gain, f32 pan)
+{
+    if (!e.aud) return;
+    
+    u32 w = aud_qw;
+    if (w - __atomic_load_n(&aud_qr, __ATOMIC_ACQUIRE) == AUD_CMDS) return;
+    aud_voice* c = &aud_q[w & (AUD_CMDS - 1)];
+    c->s = NULL;
+    c->pos = 0;
+    aud_gains(c, gain, pan);
+    c->live = 1;
+    c->m = NULL;
+    c->stop = 0;
+    syn_start(&c->syn, p, ms, AUD_RATE);
+    c->trig = tm_ns();
+    __atomic_store_n(&aud_qw, w + 1, __ATOMIC_RELEASE);
+}
+
+void aud_fin(void)
+{
+    if (!e.aud) return;
+    
+    __atomic_store_n(&aud_quit, 1, __ATOMIC_RELEASE);
+    pthread_join(aud_thr, NULL);
+    aud_dev->close();
+    e.aud = 0;
+    
+    aud_stats st;
+    aud_stat(&st);
+    u32 np = st.periods ? st.periods : 1;
+    u32 nv = st.plays ? st.plays : 1;
+    printf("Audio shutdown (%u periods, %u underruns, mix avg %.1f us max %.1f us, "
+           "latency avg %.1f ms max %.1f ms)\n",
+           st.periods, st.underruns, st.mix_ns_sum / np / 1e3, st.mix_ns_max / 1e3,
+           st.lat_ns_sum / nv / 1e6, st.lat_ns_max / 1e6);
+}
+
+// Snapshot of the audio counters; safe to call from the main thread
+void aud_stat(aud_stats* st)
+{
+    st->out = aud_st.out;
+    st->periods = __atomic_load_n(&aud_st.periods, __ATOMIC_RELAXED);
+    st->underruns = __atomic_load_n(&aud_st.underruns, __ATOMIC_RELAXED);
+    st->plays = __atomic_load_n(&aud_st.plays, __ATOMIC_RELAXED);
+    st->mix_ns = __atomic_load_n(&aud_st.mix_ns, __ATOMIC_RELAXED);
+    st->mix_ns_max = __atomic_load_n(&aud_st.mix_ns_max, __ATOMIC_RELAXED);
+    st->mix_ns_sum = __atomic_load_n(&aud_st.mix_ns_sum, __ATOMIC_RELAXED);
+    st->lat_ns = __atomic_load_n(&aud_st.lat_ns, __ATOMIC_RELAXED);
+    st->lat_ns_max = __atomic_load_n(&aud_st.lat_ns_max, __ATOMIC_RELAXED);
+    st->lat_ns_sum = __atomic_load_n(&aud_st.lat_ns_sum, __ATOMIC_RELAXED);
+}
+
+snd* snd_get(u32 id)
+{
+    return (snd*)res_get(id);
+}
+
+// Music streaming implementation
+u32 mus_open(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open music: %s\n", path);
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 12 || (u64)st.st_size > 0xFFFFFFFFu) {
+        close(fd);
+        fprintf(stderr, "Not a WAV file: %s\n", path);
+        return 0;
+    }
+    
+    // Nothing is read up front; the mixer faults pages in as it plays
+    u8* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map music: %s\n", path);
+        return 0;
+    }
+    
+    u32 size = st.st_size;
+    if (memcmp(base, "RIFF", 4) || memcmp(base + 8, "WAVE", 4)) {
+        munmap(base, size);
+        fprintf(stderr, "Not a WAV file: %s\n", path);
+        return 0;
+    }
+    
+    // Walk the chunks for fmt and data
+    u16 fmt = 0, ch = 0, bits = 0;
+    u32 rate = 0;
+    const u8* data = NULL;
+    u32 bytes = 0;
+    for (u32 off = 12; off + 8 <= size; ) {
+        u32 csz;
+        memcpy(&csz, base + off + 4, 4);
+        const u8* c = base + off + 8;
+        if (csz > size - off - 8) csz = size - off - 8;
+        if (!memcmp(base + off, "fmt ", 4) && csz >= 16) {
+            memcpy(&fmt, c, 2);
+            memcpy(&ch, c + 2, 2);
+            memcpy(&rate, c + 4, 4);
+            memcpy(&bits, c + 14, 2);
+        } else if (!memcmp(base + off, "data", 4)) {
+            data = c;
+            bytes = csz;
+            break;
+        }
+        off += 8 + csz + (csz & 1);
+    }
+    
+    // The mixer does not resample, and reads samples in place
+    if (!data || fmt != 1 || bits != 16 || (ch != 1 && ch != 2) ||
+        rate != AUD_RATE || ((data - base) & 1)) {
+        munmap(base, size);
+        fprintf(stderr, "Unsupported WAV format (must be 16-bit PCM, %d Hz): %s\n", AUD_RATE, path);
+        return 0;
+    }
+    
+    mus* m = mem_alloc(sizeof(mus));
+    if (!m) {
+        munmap(base, size);
+        return 0;
+    }
+    
+    m->base = base;
+    m->size = size;
+    m->data = (const s16*)data;
+    m->ch = (u8)ch;
+    m->len = bytes / (ch * sizeof(s16));
+    m->loop_beg = 0;
+    m->loop_end = 0;
+    
+    // Playback is linear, let the kernel read ahead aggressively
+    madvise(base, size, MADV_SEQUENTIAL);
+    
+    printf("Opened music: %s (%.1f s)\n", path, (f32)m->len / AUD_RATE);
+    return res_add(m, RES_MUS, path);
+}
+
+// Loop frames [beg, end) once playback reaches end; end 0 plays once.
+// Set before mus_play, the mixer reads these while the track plays
+void mus_loop(u32 id, u32 beg, u32 end)
+{
+    mus* m = (mus*)res_get(id);
+    if (!m) return;
+    if (end > m->len) end = m->len;
+    if (beg >= end) end = 0;
+    m->loop_beg = end ? beg : 0;
+    m->loop_end = end;
+}
+
+// Queue a music command, waiting for room; stops must not be dropped
+static u32 mus_cmd(const mus* m, u8 stop, f32 gain)
+{
+    u32 w = aud_qw;
+    while (w - __atomic_load_n(&aud_qr, __ATOMIC_ACQUIRE) == AUD_CMDS) sched_yield();
+    aud_voice* c = &aud_q[w & (AUD_CMDS - 1)];
+    c->s = NULL;
+    c->pos = 0;
+    aud_gains(c, gain, 0.0f);
+    c->live = 0;
+    c->m = m;
+    c->stop = stop;
+    c->trig = stop ? 0 : tm_ns();
+    __atomic_store_n(&aud_qw, w + 1, __ATOMIC_RELEASE);
+    return w;
+}
+
+void mus_play(u32 id, f32 gain)
+{
+    mus* m = (mus*)res_get(id);
+    if (!e.aud || !m) return;
+    mus_cmd(m, 0, gain);
+}
+
+void mus_stop(u32 id)
+{
+    mus* m = (mus*)res_get(id);
+    if (!e.aud || !m) return;
+    mus_cmd(m, 1, 0.0f);
+}
+
+// Stop and unmap; waits until the audio thread has let go of the track
+void mus_close(u32 id)
+{
+    mus* m = (mus*)res_get(id);
+    if (!m) return;
+    if (e.aud) {
+        u32 w = mus_cmd(m, 1, 0.0f);
+        while ((s32)(__atomic_load_n(&aud_qr, __ATOMIC_ACQUIRE) - w) <= 0) sched_yield();
+    }
+    res_del(id);
+}
+
+// ECS implementation
+#define ECS_PENDING 0xFFFFFFFFu // no archetype yet (created while iterating)
+#define ECS_RESERVED 1          // row of a pending spare nobody holds yet
+
+// Chunk header; component arrays follow at the archetype's offsets
+typedef struct {
+    u32 n;
+    ecs_ent ents[ECS_CHUNK];
+} ecs_chunk;
+
+typedef struct {
+    ecs_mask mask;
+    u32 off[ECS_COMPS]; // array offset of each component within a chunk
+    u32 bytes;          // chunk size
+    ecs_chunk** chunks; // chunks in use first, then spares
+    u32 nch;            // chunks in use, all full but the last
+    u32 nall;           // chunks allocated
+    u32 cap;
+    u32 n;              // entities
+} ecs_arch;
+
+// Where an entity's components live
+typedef struct {
+    u32 arch;
+    u32 row;  // index within the archetype; chunk row / ECS_CHUNK
+} ecs_loc;
+
+// Structural change queued while a query runs
+enum { ECS_NEW, ECS_DEL, ECS_ADD, ECS_REM, ECS_SET };
+
+typedef struct ecs_cmd {
+    struct ecs_cmd* next;
+    u8 op;
+    ecs_ent en;
+    u32 arg;    // mask for ECS_NEW, component otherwise
+    void* val;  // copied value, NULL = zeroed
+} ecs_cmd;
+
+static u32 ecs_sz[ECS_COMPS];
+static u32 ecs_nc;
+static ecs_arch* ecs_archs;
+static u32 ecs_na;
+static u32 ecs_acap;
+static hnd_pool ecs_hp;    // entity handles
+static ecs_loc* ecs_locs;  // dense, indexed through ecs_hp
+static u32 ecs_lcap;
+static u32 ecs_iter;       // queries running
+static u8 ecs_par_on;      // ecs_each_par running: handle tables are frozen
+static ecs_ent ecs_spare[ECS_SPARE]; // reserved handles for ecs_new in workers
+static u32 ecs_nspare;
+static arena ecs_ca;       // queued commands and their values
+static ecs_cmd* ecs_head;
+static ecs_cmd* ecs_tail;
+static pthread_mutex_t ecs_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+// Register a component of size bytes (0 for a tag); returns its id, or
+// ECS_NONE when all ids are taken
+u32 ecs_comp(u32 size)
+{
+    if (ecs_nc == ECS_COMPS) {
+        fprintf(stderr, "Too many ECS components\n");
+        return ECS_NONE;
+    }
+    ecs_sz[ecs_nc] = size;
+    return ecs_nc++;
+}
+
+// Archetype for a component set, created on first use
+static u32 ecs_arch_get(ecs_mask m)
+{
+    for (u32 i = 0; i < ecs_na; i++) {
+        if (ecs_archs[i].mask == m) return i;
+    }
+    
+    ecs_arch* archs = arr_grow(ecs_archs, &ecs_acap, ecs_na + 1, sizeof(ecs_arch));
+    if (!archs) return ECS_PENDING;
+    ecs_archs = archs;
+    ecs_arch* a = &ecs_archs[ecs_na];
+    memset(a, 0, sizeof(*a));
+    a->mask = m;
+    
+    // One 16-byte aligned array per component after the header
+    u32 off = (sizeof(ecs_chunk) + 15) & ~15u;
+    for (u32 c = 0; c < ecs_nc; c++) {
+        if (!(m & ECS_BIT(c))) continue;
+        a->off[c] = off;
+        off += (ecs_sz[c] * ECS_CHUNK + 15) & ~15u;
+    }
+    a->bytes = off;
+    return ecs_na++;
+}
+
+static void* ecs_ptr(const ecs_arch* a, u32 c, u32 row)
+{
+    return (u8*)a->chunks[row / ECS_CHUNK] + a->off[c] + (row % ECS_CHUNK) * ecs_sz[c];
+}
+
+// Append en with zeroed components; returns its row, ECS_PENDING on failure
+static u32 ecs_push(ecs_arch* a, ecs_ent en)
+{
+    if (a->n == a->nch * ECS_CHUNK) {
+        if (a->nch == a->nall) {
+            ecs_chunk** chunks = arr_grow(a->chunks, &a->cap, a->nall + 1, sizeof(ecs_chunk*));
+            if (!chunks) return ECS_PENDING;
+            a->chunks = chunks;
+            chunks[a->nall] = mem_alloc(a->bytes);
+            if (!chunks[a->nall]) return ECS_PENDING;
+            a->nall++;
+        }
+        a->chunks[a->nch++]->n = 0;
+    }
+    
+    u32 row = a->n++;
+    ecs_chunk* ch = a->chunks[row / ECS_CHUNK];
+    u32 r = ch->n++;
+    ch->ents[r] = en;
+    for (u32 c = 0; c < ecs_nc; c++) {
+        if (a->mask & ECS_BIT(c)) memset((u8*)ch + a->off[c] + r * ecs_sz[c], 0, ecs_sz[c]);
+    }
+    return row;
+}
+
+// Remove a row; the archetype's last entity moves into it
+static void ecs_pop(ecs_arch* a, u32 row)
+{
+    u32 last = --a->n;
+    ecs_chunk* lc = a->chunks[last / ECS_CHUNK];
+    if (row != last) {
+        for (u32 c = 0; c < ecs_nc; c++) {
+            if (a->mask & ECS_BIT(c)) memcpy(ecs_ptr(a, c, row), ecs_ptr(a, c, last), ecs_sz[c]);
+        }
+        ecs_ent moved = lc->ents[last % ECS_CHUNK];
+        a->chunks[row / ECS_CHUNK]->ents[row % ECS_CHUNK] = moved;
+        ecs_locs[hnd_idx(&ecs_hp, moved)].row = row;
+    }
+    if (!--lc->n) a->nch--;
+}
+
+// Store en in the archetype for m, keeping the components both have
+static void ecs_move(ecs_ent en, ecs_mask m)
+{
+    u32 d = hnd_idx(&ecs_hp, en);
+    if (d == HND_NONE) return;
+    ecs_loc old = ecs_locs[d];
+    if (old.arch != ECS_PENDING && ecs_archs[old.arch].mask == m) return;
+    
+    u32 ai = ecs_arch_get(m);
+    if (ai == ECS_PENDING) return;
+    ecs_arch* a = &ecs_archs[ai];
+    u32 row = ecs_push(a, en);
+    if (row == ECS_PENDING) return;
+    
+    if (old.arch != ECS_PENDING) {
+        ecs_arch* o = &ecs_archs[old.arch];
+        for (u32 c = 0; c < ecs_nc; c++) {
+            if (o->mask & m & ECS_BIT(c)) memcpy(ecs_ptr(a, c, row), ecs_ptr(o, c, old.row), ecs_sz[c]);
+        }
+        ecs_pop(o, old.row);
+    }
+    ecs_locs[d].arch = ai;
+    ecs_locs[d].row = row;
+}
+
+static void ecs_kill(ecs_ent en)
+{
+    u32 d = hnd_idx(&ecs_hp, en);
+    if (d == HND_NONE) return;
+    if (ecs_locs[d].arch != ECS_PENDING) ecs_pop(&ecs_archs[ecs_locs[d].arch], ecs_locs[d].row);
+    hnd_del(&ecs_hp, en);
+    ecs_locs[d] = ecs_locs[ecs_hp.n];
+}
+
+// New handle with no storage yet
+static ecs_ent ecs_reserve(void)
+{
+    // Locations grow first, so a failure leaves the pool untouched
+    if (ecs_hp.n == ecs_lcap) {
+        ecs_loc* locs = arr_grow(ecs_locs, &ecs_lcap, ecs_hp.n + 1, sizeof(ecs_loc));
+        if (!locs) return 0;
+        ecs_locs = locs;
+    }
+    u32 h = hnd_new(&ecs_hp);
+    if (!h) return 0;
+    ecs_locs[ecs_hp.n - 1].arch = ECS_PENDING;
+    ecs_locs[ecs_hp.n - 1].row = 0;
+    return h;
+}
+
+// Queue a change for ecs_flush; safe from any thread
+static void ecs_defer(u8 op, ecs_ent en, u32 arg, const void* val)
+{
+    pthread_mutex_lock(&ecs_mtx);
+    ecs_cmd* cmd = arena_alloc(&ecs_ca, sizeof(ecs_cmd));
+    if (cmd) {
+        cmd->next = NULL;
+        cmd->op = op;
+        cmd->en = en;
+        cmd->arg = arg;
+        cmd->val = NULL;
+        if (val && ecs_sz[arg]) {
+            cmd->val = arena_alloc(&ecs_ca, ecs_sz[arg]);
+            if (cmd->val) memcpy(cmd->val, val, ecs_sz[arg]);
+        }
+        if (ecs_tail) {
+            ecs_tail->next = cmd;
+        } else {
+            ecs_head = cmd;
+        }
+        ecs_tail = cmd;
+    }
+    pthread_mutex_unlock(&ecs_mtx);
+}
+
+// Create an entity with zeroed components m. Inside a query the handle is
+// valid at once, but the entity is stored (and matched) only after it
+ecs_ent ecs_new(ecs_mask m)
+{
+    if (ecs_par_on) {
+        // Workers may be reading the handle tables, so take a spare
+        pthread_mutex_lock(&ecs_mtx);
+        ecs_ent en = ecs_nspare ? ecs_spare[--ecs_nspare] : 0;
+        if (en) ecs_locs[hnd_idx(&ecs_hp, en)].row = 0;
+        pthread_mutex_unlock(&ecs_mtx);
+        if (en) ecs_defer(ECS_NEW, en, m, NULL);
+        return en;
+    }
+    if (ecs_iter) {
+        ecs_ent en = ecs_reserve();
+        if (en) ecs_defer(ECS_NEW, en, m, NULL);
+        return en;
+    }
+    
+    ecs_ent en = ecs_reserve();
+    if (en) ecs_move(en, m);
+    return en;
+}
+
+void ecs_del(ecs_ent en)
+{
+    if (ecs_iter) {
+        ecs_defer(ECS_DEL, en, 0, NULL);
+        return;
+    }
+    ecs_kill(en);
+}
+
+// Add component c, set to val (zeroed if NULL)
+void ecs_add(ecs_ent en, u32 c, const void* val)
+{
+    if (c >= ecs_nc) return;
+    if (ecs_iter) {
+        ecs_defer(ECS_ADD, en, c, val);
+        return;
+    }
+    
+    u32 d = hnd_idx(&ecs_hp, en);
+    if (d == HND_NONE) return;
+    ecs_mask m = ecs_locs[d].arch == ECS_PENDING ? 0 : ecs_archs[ecs_locs[d].arch].mask;
+    ecs_move(en, m | ECS_BIT(c));
+    if (val) ecs_set(en, c, val);
+}
+
+void ecs_rem(ecs_ent en, u32 c)
+{
+    if (c >= ecs_nc) return;
+    if (ecs_iter) {
+        ecs_defer(ECS_REM, en, c, NULL);
+        return;
+    }
+    
+    u32 d = hnd_idx(&ecs_hp, en);
+    if (d == HND_NONE || ecs_locs[d].arch == ECS_PENDING) return;
+    ecs_move(en, ecs_archs[ecs_locs[d].arch].mask & ~ECS_BIT(c));
+}
+
+// Copy val into component c; queued if the entity does not have it yet
+// because its creation or ecs_add is still queued
+void ecs_set(ecs_ent en, u32 c, const void* val)
+{
+    void* p = ecs_get(en, c);
+    if (p) {
+        memcpy(p, val, ecs_sz[c]);
+    } else if (ecs_iter && c < ecs_nc) {
+        ecs_defer(ECS_SET, en, c, val);
+    }
+}
+
+// Component c of en, NULL if it has none; valid until the next
+// structural change is applied
+void* ecs_get(ecs_ent en, u32 c)
+{
+    u32 d = hnd_idx(&ecs_hp, en);
+    if (d == HND_NONE || c >= ecs_nc || ecs_locs[d].arch == ECS_PENDING) return NULL;
+    ecs_arch* a = &ecs_archs[ecs_locs[d].arch];
+    if (!(a->mask & ECS_BIT(c))) return NULL;
+    return ecs_ptr(a, c, ecs_locs[d].row);
+}
+
+// Spares are allocated but not alive until ecs_new hands them out
+u8 ecs_alive(ecs_ent en)
+{
+    u32 d = hnd_idx(&ecs_hp, en);
+    return d != HND_NONE && (ecs_locs[d].arch != ECS_PENDING || ecs_locs[d].row != ECS_RESERVED);
+}
+
+// Entities having every component in all
+u32 ecs_count(ecs_mask all)
+{
+    u32 n = 0;
+    for (u32 i = 0; i < ecs_na; i++) {
+        if ((ecs_archs[i].mask & all) == all) n += ecs_archs[i].n;
     }
+    return n;
 }
 
-void part_init(void)
+static void ecs_view_mk(ecs_view* v, const ecs_arch* a, u32 k)
 {
-    e.parts = NULL;
-    e.np = 0;
-    e.emits = NULL;
-    e.ne = 0;
+    ecs_chunk* ch = a->chunks[k];
+    v->n = ch->n;
+    v->ents = ch->ents;
+    for (u32 c = 0; c < ECS_COMPS; c++) {
+        v->col[c] = a->mask & ECS_BIT(c) ? (u8*)ch + a->off[c] : NULL;
+    }
 }
 
-void part_add(v2 pos, v2 vel, col clr, f32 life, u8 type)
+// Run fn over every chunk whose archetype has all components in all
+void ecs_each(ecs_mask all, ecs_fn fn, void* arg)
 {
-    if (e.np % 50 == 0) {
-        e.parts = realloc(e.parts, (e.np + 50) * sizeof(part));
+    ecs_iter++;
+    for (u32 i = 0; i < ecs_na; i++) {
+        const ecs_arch* a = &ecs_archs[i];
+        if ((a->mask & all) != all) continue;
+        for (u32 k = 0; k < a->nch; k++) {
+            ecs_view v;
+            ecs_view_mk(&v, a, k);
+            fn(&v, arg);
+        }
     }
-    e.parts[e.np++] = part_mk(pos, vel, clr, life, type);
+    if (!--ecs_iter) ecs_flush();
 }
 
-void part_emit_add(v2 pos, v2 vel_range, f32 life_range, u8 type, u32 rate)
+typedef struct {
+    const ecs_arch* a;
+    u32 k;
+} ecs_item;
+
+typedef struct {
+    const ecs_item* items;
+    ecs_fn fn;
+    void* arg;
+} ecs_par;
+
+static void ecs_par_fn(void* arg, u32 beg, u32 end)
 {
-    if (e.ne % 5 == 0) {
-        e.emits = realloc(e.emits, (e.ne + 5) * sizeof(part_emit));
+    ecs_par* p = arg;
+    for (u32 i = beg; i < end; i++) {
+        ecs_view v;
+        ecs_view_mk(&v, p->items[i].a, p->items[i].k);
+        p->fn(&v, p->arg);
     }
-    e.emits[e.ne++] = part_emit_mk(pos, vel_range, life_range, type, rate);
 }
 
-void part_upd(void)
+// ecs_each with the chunks spread over the job workers; chunks share no
+// entities, so fn may write its view freely. Main thread only
+void ecs_each_par(ecs_mask all, ecs_fn fn, void* arg)
 {
-    // Update particles
-    for (u32 i = 0; i < e.np; i++) {
-        if (!e.parts[i].active) continue;
-        
-        // Apply acceleration (gravity for dust/smoke, none for sparks)
-        if (e.parts[i].type != PART_SPARK) {
-            e.parts[i].acc.y += 0.05f;
-        }
-        
-        // Update velocity and position
-        e.parts[i].vel = v2_add(e.parts[i].vel, e.parts[i].acc);
-        e.parts[i].pos = v2_add(e.parts[i].pos, e.parts[i].vel);
-        
-        // Decrease life
-        e.parts[i].life -= 0.016f; // ~60fps
-        
-        // Deactivate if life is over
-        if (e.parts[i].life <= 0) {
-            e.parts[i].active = 0;
+    u32 n = 0;
+    for (u32 i = 0; i < ecs_na; i++) {
+        if ((ecs_archs[i].mask & all) == all) n += ecs_archs[i].nch;
+    }
+    if (!n) return;
+    
+    ecs_item* items = frame_alloc(n * sizeof(ecs_item));
+    if (!items) {
+        ecs_each(all, fn, arg);
+        return;
+    }
+    n = 0;
+    for (u32 i = 0; i < ecs_na; i++) {
+        if ((ecs_archs[i].mask & all) != all) continue;
+        for (u32 k = 0; k < ecs_archs[i].nch; k++) {
+            items[n].a = &ecs_archs[i];
+            items[n++].k = k;
         }
     }
     
-    // Generate particles from emitters
-    for (u32 i = 0; i < e.ne; i++) {
-        part_emit_gen(&e.emits[i]);
+    // Top up the spares now; the tables must not move while workers run
+    while (ecs_nspare < ECS_SPARE) {
+        ecs_ent en = ecs_reserve();
+        if (!en) break;
+        ecs_locs[ecs_hp.n - 1].row = ECS_RESERVED;
+        ecs_spare[ecs_nspare++] = en;
     }
+    
+    ecs_par p = {items, fn, arg};
+    job_ctr ctr = {0};
+    ecs_iter++;
+    ecs_par_on = 1;
+    job_for(ecs_par_fn, &p, n, 1, &ctr);
+    job_wait(&ctr);
+    ecs_par_on = 0;
+    if (!--ecs_iter) ecs_flush();
 }
 
-void part_drw(void)
+// Apply queued changes in order; runs by itself when the outermost query
+// returns
+void ecs_flush(void)
 {
-    for (u32 i = 0; i < e.np; i++) {
-        if (!e.parts[i].active) continue;
-        
-        // Calculate alpha based on life
-        f32 alpha = e.parts[i].life / e.parts[i].max_life;
-        col c = e.parts[i].clr;
-        
-        // Adjust color based on alpha
-        col draw_col = {
-            (u8)(c.r * alpha),
-            (u8)(c.g * alpha),
-            (u8)(c.b * alpha)
-        };
-        
-        set_col(draw_col);
-        
-        // Draw different shapes based on type
-        switch (e.parts[i].type) {
-            case PART_DUST:
-                XDrawPoint(e.dpy, e.wid, e.gc, 
-                          (int)e.parts[i].pos.x, (int)e.parts[i].pos.y);
+    if (ecs_iter) return;
+    for (ecs_cmd* cmd = ecs_head; cmd; cmd = cmd->next) {
+        switch (cmd->op) {
+            case ECS_NEW:
+                ecs_move(cmd->en, cmd->arg);
                 break;
-            case PART_SPARK:
-                XDrawLine(e.dpy, e.wid, e.gc,
-                         (int)e.parts[i].pos.x, (int)e.parts[i].pos.y,
-                         (int)(e.parts[i].pos.x - e.parts[i].vel.x),
-                         (int)(e.parts[i].pos.y - e.parts[i].vel.y));
+            case ECS_DEL:
+                ecs_kill(cmd->en);
                 break;
-            case PART_SMOKE:
-                XFillArc(e.dpy, e.wid, e.gc,
-                        (int)(e.parts[i].pos.x - 2), (int)(e.parts[i].pos.y - 2),
-                        4, 4, 0, 360*64);
+            case ECS_ADD:
+                ecs_add(cmd->en, cmd->arg, cmd->val);
+                break;
+            case ECS_REM:
+                ecs_rem(cmd->en, cmd->arg);
+                break;
+            case ECS_SET:
+                if (cmd->val) ecs_set(cmd->en, cmd->arg, cmd->val);
                 break;
         }
     }
+    ecs_head = ecs_tail = NULL;
+    arena_reset(&ecs_ca);
 }
 
-void part_clear(void)
+// Delete every entity and release the spares, keeping the archetypes and
+// their chunks for reuse; outside queries only
+void ecs_clear(void)
 {
-    if (e.parts) {
-        free(e.parts);
-        e.parts = NULL;
-        e.np = 0;
+    if (ecs_iter) return;
+    for (u32 i = 0; i < ecs_na; i++) {
+        ecs_archs[i].nch = 0;
+        ecs_archs[i].n = 0;
     }
-    if (e.emits) {
-        free(e.emits);
-        e.emits = NULL;
-        e.ne = 0;
+    while (ecs_hp.n) {
+        u32 slot = ecs_hp.dns[ecs_hp.n - 1];
+        hnd_del(&ecs_hp, (ecs_hp.gen[slot] << HND_IDX_BITS) | slot);
     }
+    ecs_nspare = 0;
 }
 
-// Resource functions implementation
-u32 res_add(void* data, u8 type, const char* name)
+// Free every entity and archetype and forget the component ids
+void ecs_fin(void)
 {
-    if (e.rm.nr % 10 == 0) {
-        e.rm.ress = realloc(e.rm.ress, (e.rm.nr + 10) * sizeof(res));
+    ecs_clear();
+    for (u32 i = 0; i < ecs_na; i++) {
+        for (u32 k = 0; k < ecs_archs[i].nall; k++) {
+            free(ecs_archs[i].chunks[k]);
+        }
+        free(ecs_archs[i].chunks);
     }
-    
-    res* r = &e.rm.ress[e.rm.nr++];
-    r->id = e.rm.next_id++;
-    r->type = type;
-    r->data = data;
-    strncpy(r->name, name, sizeof(r->name) - 1);
-    r->name[sizeof(r->name) - 1] = '\0';
-    
-    return r->id;
+    free(ecs_archs);
+    ecs_archs = NULL;
+    ecs_na = ecs_acap = 0;
+    hnd_free(&ecs_hp);
+    free(ecs_locs);
+    ecs_locs = NULL;
+    ecs_lcap = ecs_nspare = 0;
+    arena_fin(&ecs_ca);
+    ecs_head = ecs_tail = NULL;
+    ecs_nc = 0;
 }
 
-void* res_get(u32 id)
+// Scene functions implementation
+void scn_add(u32 id, scn_init_fn init, scn_upd_fn upd, scn_drw_fn drw, scn_fin_fn fin)
 {
-    for (u32 i = 0; i < e.rm.nr; i++) {
-        if (e.rm.ress[i].id == id) {
-            return e.rm.ress[i].data;
-        }
+    if (e.sm.ns == e.sm.cap) {
+        scn* scns = arr_grow(e.sm.scns, &e.sm.cap, e.sm.ns + 1, sizeof(scn));
+        if (!scns) return;
+        e.sm.scns = scns;
     }
-    return NULL;
+    
+    scn* s = &e.sm.scns[e.sm.ns++];
+    s->id = id;
+    s->init = init;
+    s->upd = upd;
+    s->drw = drw;
+    s->fin = fin;
+    s->active = 0;
+    s->assets = NULL;
+    s->na = 0;
+    s->flags = 0;
+    s->suspend = NULL;
+    s->resume = NULL;
 }
 
-void* res_find(const char* name)
+// Choose what a scene does while covered, and what it hears when it is
+// covered and uncovered
+void scn_cover(u32 id, u8 flags, scn_sus_fn suspend, scn_res_fn resume)
 {
-    for (u32 i = 0; i < e.rm.nr; i++) {
-        if (strcmp(e.rm.ress[i].name, name) == 0) {
-            return e.rm.ress[i].data;
+    for (u32 i = 0; i < e.sm.ns; i++) {
+        if (e.sm.scns[i].id == id) {
+            e.sm.scns[i].flags = flags;
+            e.sm.scns[i].suspend = suspend;
+            e.sm.scns[i].resume = resume;
         }
     }
-    return NULL;
 }
 
-void res_del(u32 id)
+// Declare the textures a scene needs; a is kept, not copied
+void scn_assets(u32 id, const scn_asset* a, u32 n)
 {
-    for (u32 i = 0; i < e.rm.nr; i++) {
-        if (e.rm.ress[i].id == id) {
-            // Free the resource data
-            if (e.rm.ress[i].type == RES_SND) {
-                snd* s = (snd*)e.rm.ress[i].data;
-                if (s && s->data) {
-                    free(s->data);
-                }
-            } else if (e.rm.ress[i].type == RES_TEX) {
-                tex* t = (tex*)e.rm.ress[i].data;
-                if (t && t->data) {
-                    free(t->data);
-                }
-            } else if (e.rm.ress[i].type == RES_FONT) {
-                font* f = (font*)e.rm.ress[i].data;
-                if (f) {
-                    for (u8 j = 0; j < f->num_chars; j++) {
-                        free(f->chars[j].data);
-                    }
-                    free(f->chars);
-                    tex_free(f->id);
-                }
-            }
-            free(e.rm.ress[i].data);
-            
-            // Move last element to this position
-            if (i < e.rm.nr - 1) {
-                e.rm.ress[i] = e.rm.ress[e.rm.nr - 1];
-            }
-            e.rm.nr--;
-            return;
+    for (u32 i = 0; i < e.sm.ns; i++) {
+        if (e.sm.scns[i].id == id) {
+            e.sm.scns[i].assets = a;
+            e.sm.scns[i].na = n;
         }
     }
 }
 
-void res_clear(void)
+// Texture handle for an asset, loading in the background when needed
+static u32 scn_tex(const scn_asset* a)
 {
-    for (u32 i = 0; i < e.rm.nr; i++) {
-        if (e.rm.ress[i].type == RES_SND) {
-            snd* s = (snd*)e.rm.ress[i].data;
-            if (s && s->data) {
-                free(s->data);
-            }
-        } else if (e.rm.ress[i].type == RES_TEX) {
-            tex* t = (tex*)e.rm.ress[i].data;
-            if (t && t->data) {
-                free(t->data);
-            }
-        } else if (e.rm.ress[i].type == RES_FONT) {
-            font* f = (font*)e.rm.ress[i].data;
-            if (f) {
-                for (u8 j = 0; j < f->num_chars; j++) {
-                    free(f->chars[j].data);
-                }
-                free(f->chars);
-                tex_free(f->id);
-            }
-        }
-        free(e.rm.ress[i].data);
+    u32 id = e.pak && a->name ? pak_tex(e.pak, a->name) : 0;
+    if (!id && a->path) id = tex_load_async(a->path);
+    return id;
+}
+
+// Drop the references a preparation held
+static void scn_unprep(void)
+{
+    for (u32 i = 0; i < e.sm.np; i++) {
+        tex_free(e.sm.prep[i]);
     }
-    free(e.rm.ress);
-    e.rm.ress = NULL;
-    e.rm.nr = 0;
-    e.rm.next_id = 1;
+    e.sm.np = 0;
+    e.sm.next = 0;
+    e.sm.go = 0;
 }
 
-// Audio functions implementation
-void aud_ini(void)
+// Start loading a scene's assets while the current scene keeps running;
+// scn_go switches once they are in
+void scn_prep(u32 id)
 {
-    int err;
+    if (e.sm.next == id) return;
+    scn_unprep();
     
-    // Open PCM device
-    err = snd_pcm_open((snd_pcm_t**)&e.ahan, "default", SND_PCM_STREAM_PLAYBACK, 0);
-    if (err < 0) {
-        fprintf(stderr, "Audio open error: %s\n", snd_strerror(err));
-        e.aud = 0;
-        return;
+    for (u32 i = 0; i < e.sm.ns; i++) {
+        scn* s = &e.sm.scns[i];
+        if (s->id != id) continue;
+        for (u32 k = 0; k < s->na && e.sm.np < SCN_PREP; k++) {
+            u32 t = scn_tex(&s->assets[k]);
+            if (t) e.sm.prep[e.sm.np++] = t;
+        }
+        break;
     }
-    
-    // Set parameters
-    err = snd_pcm_set_params((snd_pcm_t*)e.ahan,
-                            SND_PCM_FORMAT_S16_LE,
-                            SND_PCM_ACCESS_RW_INTERLEAVED,
-                            1, 44100, 1, 50000);
-    if (err < 0) {
-        fprintf(stderr, "Audio set params error: %s\n", snd_strerror(err));
-        snd_pcm_close((snd_pcm_t*)e.ahan);
-        e.aud = 0;
-        return;
+    e.sm.next = id;
+}
+
+// Switch to a scene as soon as its assets are loaded, then run fx
+void scn_go(u32 id, u8 fx)
+{
+    scn_prep(id);
+    e.sm.go = 1;
+    e.sm.fx = fx;
+}
+
+// Finish a pending switch whose assets have all loaded (or failed, which
+// leaves placeholders); called every frame after the update
+static void scn_poll(void)
+{
+    if (!e.sm.go) return;
+    for (u32 i = 0; i < e.sm.np; i++) {
+        tex* t = (tex*)res_get(e.sm.prep[i]);
+        if (t && !t->loaded && !t->failed && !t->evicted) return;
     }
     
-    // Generate sound samples and add to resource manager
-    snd* jump_snd = malloc(sizeof(snd));
-    *jump_snd = gen_sin(440, 200, 44100);
-    res_add(jump_snd, RES_SND, "jump");
-    
-    snd* hit_snd = malloc(sizeof(snd));
-    *hit_snd = gen_sqr(220, 100, 44100);
-    res_add(hit_snd, RES_SND, "hit");
+    // The incoming scene's init takes its own references first
+    u32 id = e.sm.next;
+    u8 fx = e.sm.fx;
+    u32 prep[SCN_PREP], np = e.sm.np;
+    memcpy(prep, e.sm.prep, np * sizeof(u32));
+    e.sm.np = 0;
+    e.sm.next = 0;
+    e.sm.go = 0;
     
-    snd* click_snd = malloc(sizeof(snd));
-    *click_snd = gen_sqr(880, 50, 44100);
-    res_add(click_snd, RES_SND, "click");
-    
-    e.aud = 1;
-    printf("Audio initialized\n");
+    scn_set(id);
+    for (u32 i = 0; i < np; i++) tex_free(prep[i]);
+    e.sm.fx_f = fx == SCN_FX_WIPE ? SCN_FX_FRAMES : 0;
 }
 
-void aud_play(u8 s)
+// Index of a scene, the first one if id is unknown
+static u32 scn_idx(u32 id)
 {
-    if (!e.aud) return;
-    
-    const char* snd_names[] = {"jump", "hit", "click"};
-    if (s >= sizeof(snd_names)/sizeof(snd_names[0])) return;
-    
-    snd* sound = (snd*)res_find(snd_names[s]);
-    if (!sound || !sound->data) return;
-    
-    int err = snd_pcm_writei((snd_pcm_t*)e.ahan, sound->data, sound->len);
-    if (err < 0) {
-        fprintf(stderr, "Audio write error: %s\n", snd_strerror(err));
-        snd_pcm_recover((snd_pcm_t*)e.ahan, err, 0);
+    for (u32 i = 0; i < e.sm.ns; i++) {
+        if (e.sm.scns[i].id == id) return i;
     }
+    return 0;
 }
 
-void aud_fin(void)
+// Put scene i on top of the stack and start it
+static void scn_enter(u32 i)
 {
-    if (!e.aud) return;
-    
-    snd_pcm_close((snd_pcm_t*)e.ahan);
-    e.aud = 0;
-    printf("Audio shutdown\n");
+    if (i >= e.sm.ns || e.sm.depth == SCN_STACK) return;
+    e.sm.lvl = e.sm.depth;
+    e.sm.stack[e.sm.depth++] = i;
+    e.sm.cur = i;
+    e.sm.gen++;
+    e.sm.scns[i].active = 1;
+    if (e.sm.scns[i].init) e.sm.scns[i].init();
 }
 
-snd* snd_get(u32 id)
+// Finish the top scene and take it off the stack
+static void scn_leave(void)
 {
-    return (snd*)res_get(id);
+    if (!e.sm.depth) return;
+    scn* s = &e.sm.scns[e.sm.stack[e.sm.depth - 1]];
+    e.sm.lvl = e.sm.depth - 1;
+    if (s->fin) s->fin();
+    s->active = 0;
+    arena_reset(&e.sa[--e.sm.depth]);
+    e.sm.cur = e.sm.depth ? e.sm.stack[e.sm.depth - 1] : 0;
+    e.sm.lvl = e.sm.depth ? e.sm.depth - 1 : 0;
+    e.sm.gen++;
 }
 
-// Scene functions implementation
-void scn_add(u32 id, scn_init_fn init, scn_upd_fn upd, scn_drw_fn drw, scn_fin_fn fin)
+// Finish every scene on the stack, top first
+static void scn_clear(void)
 {
-    if (e.sm.ns % 5 == 0) {
-        e.sm.scns = realloc(e.sm.scns, (e.sm.ns + 5) * sizeof(scn));
-    }
-    
-    scn* s = &e.sm.scns[e.sm.ns++];
-    s->id = id;
-    s->init = init;
-    s->upd = upd;
-    s->drw = drw;
-    s->fin = fin;
-    s->active = 0;
+    while (e.sm.depth) scn_leave();
 }
 
+// Replace the whole stack with one scene
 void scn_set(u32 id)
 {
-    // Deactivate current scene
-    if (e.sm.cur < e.sm.ns) {
-        scn* cur = &e.sm.scns[e.sm.cur];
-        if (cur->fin) cur->fin();
-        cur->active = 0;
-    }
-    
-    // Find and activate new scene
-    for (u32 i = 0; i < e.sm.ns; i++) {
-        if (e.sm.scns[i].id == id) {
-            e.sm.cur = i;
-            e.sm.scns[i].active = 1;
-            if (e.sm.scns[i].init) e.sm.scns[i].init();
-            return;
-        }
+    // Handed-off frames may reference what the scene frees
+    rnd_sync();
+    scn_clear();
+    scn_enter(scn_idx(id));
+}
+
+// Cover the top scene with another; the covered one keeps its state
+void scn_push(u32 id)
+{
+    if (e.sm.depth == SCN_STACK) {
+        fprintf(stderr, "Scene stack full, not pushing %u\n", id);
+        return;
     }
-    
-    // Fallback to first scene if not found
-    if (e.sm.ns > 0) {
-        e.sm.cur = 0;
-        e.sm.scns[0].active = 1;
-        if (e.sm.scns[0].init) e.sm.scns[0].init();
+    if (e.sm.depth) {
+        scn* s = &e.sm.scns[e.sm.cur];
+        if (s->suspend) s->suspend();
     }
+    scn_enter(scn_idx(id));
+}
+
+// Finish the top scene and resume the one below; the last scene stays
+void scn_pop(void)
+{
+    if (e.sm.depth < 2) return;
+    rnd_sync();
+    scn_leave();
+    scn* s = &e.sm.scns[e.sm.cur];
+    if (s->resume) s->resume();
 }
 
+// Swap the top scene for another, leaving the ones below alone
+void scn_replace(u32 id)
+{
+    rnd_sync();
+    scn_leave();
+    scn_enter(scn_idx(id));
+}
+
+// Update the top scene and any covered scene that asked to keep going,
+// bottom first
 void scn_upd(void)
 {
-    if (e.sm.cur < e.sm.ns && e.sm.scns[e.sm.cur].upd) {
-        e.sm.scns[e.sm.cur].upd();
+    PROF_BEG("scn_upd");
+    u32 n = e.sm.depth, gen = e.sm.gen;
+    for (u32 d = 0; d < n; d++) {
+        scn* s = &e.sm.scns[e.sm.stack[d]];
+        if (d + 1 < n && !(s->flags & SCN_UPD_COVERED)) continue;
+        e.sm.lvl = d;
+        if (s->upd) s->upd();
+        
+        // A scene changed the stack; the rest runs next frame
+        if (e.sm.gen != gen) break;
     }
+    e.sm.lvl = e.sm.depth ? e.sm.depth - 1 : 0;
+    PROF_END();
 }
 
 void scn_drw(void)
 {
-    if (e.sm.cur < e.sm.ns && e.sm.scns[e.sm.cur].drw) {
-        e.sm.scns[e.sm.cur].drw();
+    PROF_BEG("scn_drw");
+    for (u32 d = 0; d < e.sm.depth; d++) {
+        scn* s = &e.sm.scns[e.sm.stack[d]];
+        if (d + 1 < e.sm.depth && !(s->flags & SCN_DRW_COVERED)) continue;
+        e.sm.lvl = d;
+        if (s->drw) s->drw();
     }
+    e.sm.lvl = e.sm.depth ? e.sm.depth - 1 : 0;
+    
+    // Wipe: the curtain shrinks to the right as the new scene shows
+    if (e.sm.fx_f) {
+        s32 w = 800 * e.sm.fx_f / SCN_FX_FRAMES;
+        spr_drw(spr_mk(v2_mk(800 - w, 0), v2_mk(w, 600), (col){0, 0, 0}));
+        e.sm.fx_f--;
+    }
+    PROF_END();
 }
 
 // Menu scene implementation
@@ -968,20 +4469,23 @@ static void menu_init(void)
 {
     printf("Menu scene initialized\n");
     part_clear();
+    
+    // Load the game's assets while the menu is up
+    scn_prep(SCENE_GAME);
 }
 
 static void menu_upd(void)
 {
     // Switch to game scene on space
-    if (key(KEY_SPACE)) {
-        scn_set(SCENE_GAME);
+    if (key(KEY_SPACE) && !e.sm.go) {
+        scn_go(SCENE_GAME, SCN_FX_WIPE);
         aud_play(SND_CLICK);
     }
 }
 
 static void menu_drw(void)
 {
-    XClearWindow(e.dpy, e.wid);
+    drw_clear();
     
     // Draw title with font
     if (e.def_font) {
@@ -990,10 +4494,9 @@ static void menu_drw(void)
         font_drw(e.def_font, "Press ESC to quit", v2_mk(400, 300), (col){0, 0, 0}, FONT_CENTER);
     } else {
         // Fallback to XDrawString
-        set_col((col){0, 0, 0});
-        XDrawString(e.dpy, e.wid, e.gc, 300, 200, "GAME ENGINE DEMO", 16);
-        XDrawString(e.dpy, e.wid, e.gc, 320, 250, "Press SPACE to play", 19);
-        XDrawString(e.dpy, e.wid, e.gc, 340, 300, "Press ESC to quit", 17);
+        drw_str(v2_mk(300, 200), (col){0, 0, 0}, "GAME ENGINE DEMO");
+        drw_str(v2_mk(320, 250), (col){0, 0, 0}, "Press SPACE to play");
+        drw_str(v2_mk(340, 300), (col){0, 0, 0}, "Press ESC to quit");
     }
     
     // Draw FPS counter
@@ -1002,8 +4505,7 @@ static void menu_drw(void)
     if (e.def_font) {
         font_drw(e.def_font, buf, v2_mk(10, 20), (col){0, 0, 0}, FONT_LEFT);
     } else {
-        set_col((col){0, 0, 0});
-        XDrawString(e.dpy, e.wid, e.gc, 10, 20, buf, strlen(buf));
+        drw_str(v2_mk(10, 20), (col){0, 0, 0}, buf);
     }
 }
 
@@ -1012,31 +4514,120 @@ static void menu_fin(void)
     printf("Menu scene finished\n");
 }
 
-// Game scene implementation
-static v2 pos, vel, acc;
-static u8 was_space;
-static spr player;
-static u8 part_enabled = 1;
-static u32 player_tex = 0;
+// Game scene implementation: the player and the obstacles are entities,
+// steered, moved, collided and drawn by systems
+typedef struct {
+    v2 sz;
+    col clr;
+    u32 tex;   // texture handle, 0 = flat colour
+} game_body;
+
+// c_ctrl: driven by input; c_stat: never moves, baked into the background
+static u32 c_pos, c_vel, c_acc, c_body, c_ctrl, c_stat;
+static u32 player_tex_keep = 0; // engine-lifetime reference, see ini()
+static const scn_asset game_assets[] = {
+    {"player", "player.bmp"},
+};
+
+// Scene state, in the scene's arena
+typedef struct {
+    ecs_ent player;
+    u32 tex;        // player texture reference
+    u8 parts;       // particles on
+    u8 was_space;
+    u8 was_esc;
+    u8 was_p;
+    u8 was_b;
+} game_st;
+
+static game_st* gs;
+
+// Static bodies as sprites, for collision and the background layer
+typedef struct {
+    spr* s;
+    u32 n;
+} game_solids;
+
+static void game_solid(ecs_view* v, void* arg)
+{
+    game_solids* o = arg;
+    v2* pos = ECS_COL(v, v2, c_pos);
+    game_body* body = ECS_COL(v, game_body, c_body);
+    
+    for (u32 i = 0; i < v->n; i++) {
+        o->s[o->n++] = spr_mk(pos[i], body[i].sz, body[i].clr);
+    }
+}
+
+static game_solids game_solids_get(void)
+{
+    game_solids o = {NULL, 0};
+    u32 n = ecs_count(ECS_BIT(c_pos) | ECS_BIT(c_body) | ECS_BIT(c_stat));
+    o.s = n ? frame_alloc(n * sizeof(spr)) : NULL;
+    if (o.s) ecs_each(ECS_BIT(c_pos) | ECS_BIT(c_body) | ECS_BIT(c_stat), game_solid, &o);
+    return o;
+}
 
 static void game_init(void)
 {
     printf("Game scene initialized\n");
     
-    // Initialize physics
-    pos = v2_mk(100.0f, 100.0f);
-    vel = v2_mk(2.0f, 3.0f);
-    acc = v2_mk(0.0f, 0.1f);
-    was_space = 0;
+    // Components are registered once for the engine's lifetime; without
+    // them the scene stays empty
+    static u8 comps;
+    if (!comps) {
+        c_pos = ecs_comp(sizeof(v2));
+        c_vel = ecs_comp(sizeof(v2));
+        c_acc = ecs_comp(sizeof(v2));
+        c_body = ecs_comp(sizeof(game_body));
+        c_ctrl = ecs_comp(0);
+        c_stat = ecs_comp(0);
+        comps = c_stat != ECS_NONE ? 1 : 2; // ids are taken in order
+    }
+    if (comps != 1) {
+        fprintf(stderr, "Game components unavailable\n");
+        return;
+    }
+    
+    gs = scn_alloc(sizeof(game_st));
+    if (!gs) return;
+    gs->parts = 1;
+    gs->was_space = 0;
+    gs->was_esc = 1; // the key that started the game may still be down
+    gs->was_p = 0;
+    gs->was_b = 0;
     
-    // Create player sprite
-    player = spr_mk(pos, v2_mk(50, 50), (col){255, 0, 0});
+    // Player texture, already loaded by scn_prep; cached
+    gs->tex = scn_tex(&game_assets[0]);
     
-    // Load player texture
-    player_tex = tex_load("player.bmp");
-    if (player_tex) {
-        player.tex_id = player_tex;
+    // Create the player
+    gs->player = ecs_new(ECS_BIT(c_pos) | ECS_BIT(c_vel) | ECS_BIT(c_acc) |
+                         ECS_BIT(c_body) | ECS_BIT(c_ctrl));
+    v2 pos = v2_mk(100.0f, 100.0f);
+    v2 vel = v2_mk(2.0f, 3.0f);
+    v2 acc = v2_mk(0.0f, 0.1f);
+    game_body body = {v2_mk(50, 50), (col){255, 0, 0}, gs->tex};
+    ecs_set(gs->player, c_pos, &pos);
+    ecs_set(gs->player, c_vel, &vel);
+    ecs_set(gs->player, c_acc, &acc);
+    ecs_set(gs->player, c_body, &body);
+    
+    // Platform and obstacles never move: draw them from the background layer
+    static const struct {
+        v2 pos;
+        game_body body;
+    } solids[] = {
+        {{300, 500}, {{200, 20}, {0, 255, 0}, 0}},
+        {{100, 400}, {{50, 50}, {0, 0, 255}, 0}},
+        {{600, 300}, {{50, 50}, {0, 0, 255}, 0}},
+    };
+    for (u32 i = 0; i < sizeof(solids) / sizeof(solids[0]); i++) {
+        ecs_ent en = ecs_new(ECS_BIT(c_pos) | ECS_BIT(c_body) | ECS_BIT(c_stat));
+        ecs_set(en, c_pos, &solids[i].pos);
+        ecs_set(en, c_body, &solids[i].body);
     }
+    game_solids o = game_solids_get();
+    drw_bg_set(o.s, o.n);
     
     // Initialize particles
     part_init();
@@ -1046,147 +4637,196 @@ static void game_init(void)
     part_emit_add(v2_mk(400, 300), v2_mk(0.5, 0.5), 1.5f, PART_SMOKE, 5);
 }
 
-static void game_upd(void)
+// Input: forces from the arrows, jump on a fresh SPACE press
+static void game_ctrl(ecs_view* v, void* arg)
 {
-    // Toggle particles with P key
-    static u8 was_p = 0;
-    if (key(KEY_P) && !was_p) {
-        part_enabled = !part_enabled;
-        was_p = 1;
-    } else if (!key(KEY_P)) {
-        was_p = 0;
-    }
+    u8 jump = *(u8*)arg;
+    v2* pos = ECS_COL(v, v2, c_pos);
+    v2* vel = ECS_COL(v, v2, c_vel);
+    v2* acc = ECS_COL(v, v2, c_acc);
     
-    // Toggle textures with B key
-    static u8 was_b = 0;
-    if (key(KEY_B) && !was_b) {
-        e.use_tex = !e.use_tex;
-        was_b = 1;
-    } else if (!key(KEY_B)) {
-        was_b = 0;
-    }
-    
-    // Handle input
-    if (key(KEY_UP)) acc.y = -0.2f;
-    else if (key(KEY_DOWN)) acc.y = 0.2f;
-    else acc.y = 0.1f; // Default gravity
-    
-    if (key(KEY_LEFT)) acc.x = -0.2f;
-    else if (key(KEY_RIGHT)) acc.x = 0.2f;
-    else acc.x = 0.0f;
-    
-    // Jump with sound
-    if (key(KEY_SPACE) && !was_space) {
-        vel.y = -5.0f;
-        aud_play(SND_JUMP);
-        was_space = 1;
+    for (u32 i = 0; i < v->n; i++) {
+        if (key(KEY_UP)) acc[i].y = -0.2f;
+        else if (key(KEY_DOWN)) acc[i].y = 0.2f;
+        else acc[i].y = 0.1f; // Default gravity
+        
+        if (key(KEY_LEFT)) acc[i].x = -0.2f;
+        else if (key(KEY_RIGHT)) acc[i].x = 0.2f;
+        else acc[i].x = 0.0f;
         
-        // Add jump particles
-        if (part_enabled) {
-            for (int i = 0; i < 10; i++) {
-                v2 part_vel = v2_mk(
-                    ((f32)rand() / RAND_MAX) * 4 - 2,
-                    ((f32)rand() / RAND_MAX) * -3 - 1
-                );
-                part_add(v2_mk(pos.x + 25, pos.y + 50), part_vel, 
-                        (col){255, 255, 100}, 1.0f, PART_SPARK);
+        // Jump with sound
+        if (jump) {
+            vel[i].y = -5.0f;
+            aud_play_ex(SND_JUMP, 1.0f, pos[i].x / 400.0f - 1.0f);
+            
+            // Add jump particles
+            if (gs->parts) {
+                for (int j = 0; j < 10; j++) {
+                    v2 part_vel = v2_mk(
+                        ((f32)rand() / RAND_MAX) * 4 - 2,
+                        ((f32)rand() / RAND_MAX) * -3 - 1
+                    );
+                    part_add(v2_mk(pos[i].x + 25, pos[i].y + 50), part_vel, 
+                            (col){255, 255, 100}, 1.0f, PART_SPARK);
+                }
             }
         }
-    } else if (!key(KEY_SPACE)) {
-        was_space = 0;
     }
+}
+
+// Physics integration; touches only its own chunk, so runs in parallel
+static void game_move(ecs_view* v, void* arg)
+{
+    (void)arg;
+    v2* pos = ECS_COL(v, v2, c_pos);
+    v2* vel = ECS_COL(v, v2, c_vel);
+    v2* acc = ECS_COL(v, v2, c_acc);
     
-    // Physics update
-    vel = v2_add(vel, acc);
-    pos = v2_add(pos, vel);
-    
-    // Update player sprite position
-    player.pos = pos;
+    for (u32 i = 0; i < v->n; i++) {
+        vel[i] = v2_add(vel[i], acc[i]);
+        pos[i] = v2_add(pos[i], vel[i]);
+    }
+}
+
+// Bounce moving bodies off the static ones and the window edges
+static void game_hit(ecs_view* v, void* arg)
+{
+    const game_solids* o = arg;
+    v2* pos = ECS_COL(v, v2, c_pos);
+    v2* vel = ECS_COL(v, v2, c_vel);
+    game_body* body = ECS_COL(v, game_body, c_body);
     
-    // Check collisions with sprites
-    u8 hit = 0;
-    for (u32 i = 0; i < e.ns; i++) {
-        if (spr_col(player, e.sprs[i])) {
-            hit = 1;
-            // Simple collision response
-            vel.y = -vel.y * 0.8f;
-            
-            // Position correction
-            if (pos.y < e.sprs[i].pos.y) {
-                pos.y = e.sprs[i].pos.y - player.sz.y;
-            } else {
-                pos.y = e.sprs[i].pos.y + e.sprs[i].sz.y;
-            }
-            
-            player.pos = pos;
-            
-            // Add hit particles
-            if (part_enabled && hit) {
-                for (int j = 0; j < 5; j++) {
-                    v2 part_vel = v2_mk(
-                        ((f32)rand() / RAND_MAX) * 6 - 3,
-                        ((f32)rand() / RAND_MAX) * -4 - 1
-                    );
-                    part_add(v2_mk(pos.x + 25, pos.y + 25), part_vel, 
-                            (col){200, 200, 200}, 0.8f, PART_DUST);
+    for (u32 i = 0; i < v->n; i++) {
+        spr s = spr_mk(pos[i], body[i].sz, body[i].clr);
+        
+        // Check collisions with static bodies
+        u8 hit = 0;
+        for (u32 k = 0; k < o->n; k++) {
+            if (spr_col(s, o->s[k])) {
+                hit = 1;
+                // Simple collision response
+                vel[i].y = -vel[i].y * 0.8f;
+                
+                // Position correction
+                if (pos[i].y < o->s[k].pos.y) {
+                    pos[i].y = o->s[k].pos.y - s.sz.y;
+                } else {
+                    pos[i].y = o->s[k].pos.y + o->s[k].sz.y;
+                }
+                
+                s.pos = pos[i];
+                
+                // Add hit particles
+                if (gs->parts) {
+                    for (int j = 0; j < 5; j++) {
+                        v2 part_vel = v2_mk(
+                            ((f32)rand() / RAND_MAX) * 6 - 3,
+                            ((f32)rand() / RAND_MAX) * -4 - 1
+                        );
+                        part_add(v2_mk(pos[i].x + 25, pos[i].y + 25), part_vel, 
+                                (col){200, 200, 200}, 0.8f, PART_DUST);
+                    }
                 }
             }
         }
+        
+        // Play hit sound, panned to the entity
+        if (hit) {
+            aud_play_ex(SND_HIT, 1.0f, pos[i].x / 400.0f - 1.0f);
+        }
+        
+        // Boundary collision
+        f32 mx = 800.0f - body[i].sz.x;
+        f32 my = 600.0f - body[i].sz.y;
+        if (pos[i].x > mx || pos[i].x < 0.0f) {
+            vel[i].x = -vel[i].x * 0.8f;
+            if (pos[i].x > mx) pos[i].x = mx;
+            if (pos[i].x < 0.0f) pos[i].x = 0.0f;
+        }
+        
+        if (pos[i].y > my || pos[i].y < 0.0f) {
+            vel[i].y = -vel[i].y * 0.8f;
+            if (pos[i].y > my) pos[i].y = my;
+            if (pos[i].y < 0.0f) pos[i].y = 0.0f;
+        }
+    }
+}
+
+// Bodies as sprites, textured when textures are on; static ones come
+// with the background layer
+static void game_show(ecs_view* v, void* arg)
+{
+    (void)arg;
+    if (v->col[c_stat]) return;
+    v2* pos = ECS_COL(v, v2, c_pos);
+    game_body* body = ECS_COL(v, game_body, c_body);
+    
+    for (u32 i = 0; i < v->n; i++) {
+        spr s = spr_mk(pos[i], body[i].sz, body[i].clr);
+        s.tex_id = body[i].tex;
+        if (e.use_tex && s.tex_id) {
+            spr_drw_tex(s);
+        } else {
+            spr_drw(s);
+        }
     }
+}
+
+static void game_upd(void)
+{
+    if (!gs) return;
     
-    // Play hit sound
-    if (hit) {
-        aud_play(SND_HIT);
-    }
+    // Toggle particles with P key
+    if (key(KEY_P) && !gs->was_p) gs->parts = !gs->parts;
+    gs->was_p = key(KEY_P);
     
-    // Boundary collision
-    if (pos.x > 750.0f || pos.x < 0.0f) {
-        vel.x = -vel.x * 0.8f;
-        if (pos.x > 750.0f) pos.x = 750.0f;
-        if (pos.x < 0.0f) pos.x = 0.0f;
-        player.pos = pos;
-    }
+    // Toggle textures with B key
+    if (key(KEY_B) && !gs->was_b) e.use_tex = !e.use_tex;
+    gs->was_b = key(KEY_B);
     
-    if (pos.y > 550.0f || pos.y < 0.0f) {
-        vel.y = -vel.y * 0.8f;
-        if (pos.y > 550.0f) pos.y = 550.0f;
-        if (pos.y < 0.0f) pos.y = 0.0f;
-        player.pos = pos;
-    }
+    // Steer, jump, move, then resolve collisions
+    u8 jump = key(KEY_SPACE) && !gs->was_space;
+    gs->was_space = key(KEY_SPACE);
+    ecs_each(ECS_BIT(c_pos) | ECS_BIT(c_vel) | ECS_BIT(c_acc) | ECS_BIT(c_ctrl), game_ctrl, &jump);
+    ecs_each_par(ECS_BIT(c_pos) | ECS_BIT(c_vel) | ECS_BIT(c_acc), game_move, NULL);
+    game_solids o = game_solids_get();
+    ecs_each(ECS_BIT(c_pos) | ECS_BIT(c_vel) | ECS_BIT(c_body), game_hit, &o);
     
     // Update particles
-    if (part_enabled) {
+    if (gs->parts) {
         part_upd();
     }
     
-    // Return to menu on ESC
-    if (key(KEY_ESC)) {
-        scn_set(SCENE_MENU);
+    // Pause on ESC; the game stays resident under the pause scene
+    if (key(KEY_ESC) && !gs->was_esc && !e.sm.go) {
+        scn_push(SCENE_PAUSE);
         aud_play(SND_CLICK);
     }
+    gs->was_esc = key(KEY_ESC);
 }
 
 static void game_drw(void)
 {
-    XClearWindow(e.dpy, e.wid);
+    // Static bodies come with the background layer
+    drw_bg();
+    if (!gs) return;
     
-    // Draw all sprites
-    for (u32 i = 0; i < e.ns; i++) {
-        spr_drw(e.sprs[i]);
-    }
-    
-    // Draw player (with texture if available and enabled)
-    if (e.use_tex && player.tex_id) {
-        spr_drw_tex(player);
-    } else {
-        spr_drw(player);
-    }
+    // Draw entities (with texture if available and enabled)
+    ecs_each(ECS_BIT(c_pos) | ECS_BIT(c_body), game_show, NULL);
     
     // Draw particles
-    if (part_enabled) {
+    if (gs->parts) {
         part_drw();
     }
     
+    // Player state for the HUD
+    v2 pos = v2_mk(0, 0);
+    v2 vel = v2_mk(0, 0);
+    v2* pp = ecs_get(gs->player, c_pos);
+    v2* pv = ecs_get(gs->player, c_vel);
+    if (pp) pos = *pp;
+    if (pv) vel = *pv;
+    
     // Draw info with font if available
     if (e.def_font) {
         char buf[64];
@@ -1194,12 +4834,12 @@ static void game_drw(void)
                 e.fps, pos.x, pos.y, vel.x, vel.y);
         font_drw(e.def_font, buf, v2_mk(10, 20), (col){0, 0, 0}, FONT_LEFT);
         
-        char res_buf[32];
-        snprintf(res_buf, sizeof(res_buf), "Resources: %u", e.rm.nr);
+        char res_buf[48];
+        snprintf(res_buf, sizeof(res_buf), "Resources: %u (%llu KB)", e.rm.nr, res_bytes(0) / 1024);
         font_drw(e.def_font, res_buf, v2_mk(10, 40), (col){0, 0, 0}, FONT_LEFT);
         
         char part_buf[32];
-        snprintf(part_buf, sizeof(part_buf), "Particles: %u (%s)", e.np, part_enabled ? "ON" : "OFF");
+        snprintf(part_buf, sizeof(part_buf), "Particles: %u (%s)", e.np, gs->parts ? "ON" : "OFF");
         font_drw(e.def_font, part_buf, v2_mk(10, 60), (col){0, 0, 0}, FONT_LEFT);
         
         char tex_buf[32];
@@ -1211,33 +4851,32 @@ static void game_drw(void)
         font_drw(e.def_font, "Space: Jump", v2_mk(10, 120), (col){0, 0, 0}, FONT_LEFT);
         font_drw(e.def_font, "P: Toggle particles", v2_mk(10, 140), (col){0, 0, 0}, FONT_LEFT);
         font_drw(e.def_font, "B: Toggle textures", v2_mk(10, 160), (col){0, 0, 0}, FONT_LEFT);
-        font_drw(e.def_font, "ESC: Menu", v2_mk(10, 180), (col){0, 0, 0}, FONT_LEFT);
+        font_drw(e.def_font, "ESC: Pause", v2_mk(10, 180), (col){0, 0, 0}, FONT_LEFT);
     } else {
         // Fallback to XDrawString
         char buf[64];
         snprintf(buf, sizeof(buf), "FPS: %u POS: (%.1f, %.1f) VEL: (%.1f, %.1f)", 
                 e.fps, pos.x, pos.y, vel.x, vel.y);
-        set_col((col){0, 0, 0});
-        XDrawString(e.dpy, e.wid, e.gc, 10, 20, buf, strlen(buf));
+        drw_str(v2_mk(10, 20), (col){0, 0, 0}, buf);
         
-        char res_buf[32];
-        snprintf(res_buf, sizeof(res_buf), "Resources: %u", e.rm.nr);
-        XDrawString(e.dpy, e.wid, e.gc, 10, 40, res_buf, strlen(res_buf));
+        char res_buf[48];
+        snprintf(res_buf, sizeof(res_buf), "Resources: %u (%llu KB)", e.rm.nr, res_bytes(0) / 1024);
+        drw_str(v2_mk(10, 40), (col){0, 0, 0}, res_buf);
         
         char part_buf[32];
-        snprintf(part_buf, sizeof(part_buf), "Particles: %u (%s)", e.np, part_enabled ? "ON" : "OFF");
-        XDrawString(e.dpy, e.wid, e.gc, 10, 60, part_buf, strlen(part_buf));
+        snprintf(part_buf, sizeof(part_buf), "Particles: %u (%s)", e.np, gs->parts ? "ON" : "OFF");
+        drw_str(v2_mk(10, 60), (col){0, 0, 0}, part_buf);
         
         char tex_buf[32];
         snprintf(tex_buf, sizeof(tex_buf), "Textures: %s", e.use_tex ? "ON" : "OFF");
-        XDrawString(e.dpy, e.wid, e.gc, 10, 80, tex_buf, strlen(tex_buf));
+        drw_str(v2_mk(10, 80), (col){0, 0, 0}, tex_buf);
         
         // Draw controls info
-        XDrawString(e.dpy, e.wid, e.gc, 10, 100, "Arrows: Apply force", 19);
-        XDrawString(e.dpy, e.wid, e.gc, 10, 120, "Space: Jump", 11);
-        XDrawString(e.dpy, e.wid, e.gc, 10, 140, "P: Toggle particles", 19);
-        XDrawString(e.dpy, e.wid, e.gc, 10, 160, "B: Toggle textures", 18);
-        XDrawString(e.dpy, e.wid, e.gc, 10, 180, "ESC: Menu", 9);
+        drw_str(v2_mk(10, 100), (col){0, 0, 0}, "Arrows: Apply force");
+        drw_str(v2_mk(10, 120), (col){0, 0, 0}, "Space: Jump");
+        drw_str(v2_mk(10, 140), (col){0, 0, 0}, "P: Toggle particles");
+        drw_str(v2_mk(10, 160), (col){0, 0, 0}, "B: Toggle textures");
+        drw_str(v2_mk(10, 180), (col){0, 0, 0}, "ESC: Pause");
     }
 }
 
@@ -1245,36 +4884,337 @@ static void game_fin(void)
 {
     printf("Game scene finished\n");
     part_clear();
+    drw_bg_set(NULL, 0);
+    
+    // The game is the only scene with entities
+    ecs_clear();
+    if (!gs) return;
+    
+    // Drop the scene's texture reference; the state goes with the arena
+    tex_free(gs->tex);
+    gs = NULL;
 }
 
-void ini(void)
+static void game_suspend(void)
 {
-    printf("Engine init\n");
+    printf("Game scene suspended\n");
+}
+
+static void game_resume(void)
+{
+    printf("Game scene resumed\n");
+}
+
+// Pause scene: pushed over the game, which stays drawn but frozen
+static u8 pause_esc;
+
+static void pause_init(void)
+{
+    printf("Pause scene initialized\n");
+    pause_esc = 1; // ESC opened the pause, wait for the next press
+}
+
+static void pause_upd(void)
+{
+    if (key(KEY_ESC) && !pause_esc) {
+        scn_pop();
+        aud_play(SND_CLICK);
+    } else if (key(KEY_2) && !e.sm.go) {
+        scn_go(SCENE_MENU, SCN_FX_NONE);
+        aud_play(SND_CLICK);
+    }
+    pause_esc = key(KEY_ESC);
+}
+
+static void pause_drw(void)
+{
+    // No clear: the game below has already drawn this frame
+    spr_drw(spr_mk(v2_mk(250, 220), v2_mk(300, 120), (col){40, 40, 40}));
+    if (e.def_font) {
+        font_drw(e.def_font, "PAUSED", v2_mk(400, 240), (col){255, 255, 255}, FONT_CENTER);
+        font_drw(e.def_font, "ESC: Resume", v2_mk(400, 280), (col){255, 255, 255}, FONT_CENTER);
+        font_drw(e.def_font, "2: Menu", v2_mk(400, 300), (col){255, 255, 255}, FONT_CENTER);
+    } else {
+        drw_str(v2_mk(375, 250), (col){255, 255, 255}, "PAUSED");
+        drw_str(v2_mk(365, 290), (col){255, 255, 255}, "ESC: Resume");
+        drw_str(v2_mk(375, 310), (col){255, 255, 255}, "2: Menu");
+    }
+}
+
+static void pause_fin(void)
+{
+    printf("Pause scene finished\n");
+}
+
+// Stress scene: configurable content, run unpaced by run()
+static stress_cfg stress_c;
+static u8 stress_on;
+static u32* stress_ids;     // sprite handles, scene arena
+static u32* stress_tex;     // texture handles, scene arena
+static char stress_dir[32]; // generated texture files
+static v2* stress_vel;
+
+// Select stress mode; call before ini()
+void stress_use(const stress_cfg* c)
+{
+    stress_c = *c;
+    stress_on = 1;
+}
+
+// Write a 64x64 24-bit BMP in one flat colour with a darker border, so
+// evicted textures have a file to come back from
+static u8 stress_bmp(const char* path, col c)
+{
+    u8 px[64 * 64 * 3];
+    for (u32 i = 0; i < 64 * 64; i++) {
+        u8 edge = i % 64 < 4 || i % 64 >= 60 || i < 64 * 4 || i >= 64 * 60;
+        px[i * 3] = edge ? c.b / 2 + 1 : c.b | 1;
+        px[i * 3 + 1] = edge ? c.g / 2 + 1 : c.g | 1;
+        px[i * 3 + 2] = edge ? c.r / 2 + 1 : c.r | 1;
+    }
     
-    // Initialize resource manager
-    e.rm.ress = NULL;
-    e.rm.nr = 0;
-    e.rm.next_id = 1;
+    bmp_hdr h = {0x4D42, sizeof(bmp_hdr) + sizeof(bmp_info_hdr) + sizeof(px), 0, 0,
+                 sizeof(bmp_hdr) + sizeof(bmp_info_hdr)};
+    bmp_info_hdr ih = {sizeof(bmp_info_hdr), 64, 64, 1, 24, 0, sizeof(px), 0, 0, 0, 0};
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+    u8 ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(&ih, sizeof(ih), 1, f) == 1 &&
+            fwrite(px, sizeof(px), 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+// Generate the texture set in a temporary directory and load it
+static void stress_tex_ini(void)
+{
+    char path[64];
+    stress_tex = scn_alloc(stress_c.texs * sizeof(u32));
+    strcpy(stress_dir, "/tmp/stress_XXXXXX");
+    if (!stress_tex || !mkdtemp(stress_dir)) {
+        fprintf(stderr, "Can't create stress textures\n");
+        stress_c.texs = 0;
+        return;
+    }
+    for (u32 i = 0; i < stress_c.texs; i++) {
+        snprintf(path, sizeof(path), "%s/%u.bmp", stress_dir, i);
+        col c = {(u8)(rand() % 256), (u8)(rand() % 256), (u8)(rand() % 256)};
+        stress_tex[i] = stress_bmp(path, c) ? tex_load(path) : 0;
+    }
+}
+
+static void stress_init(void)
+{
+    printf("Stress scene initialized (%u sprites, %u emitters, %u text lines)\n",
+           stress_c.sprs, stress_c.emits, stress_c.texts);
     
-    // Initialize scene manager
-    e.sm.scns = NULL;
-    e.sm.ns = 0;
-    e.sm.cur = 0;
+    srand(1);
+    stress_ids = scn_alloc(stress_c.sprs * sizeof(u32));
+    stress_vel = scn_alloc(stress_c.sprs * sizeof(v2));
+    if (!stress_ids || !stress_vel) stress_c.sprs = 0;
+    for (u32 i = 0; i < stress_c.sprs; i++) {
+        col c = {(u8)(rand() % 256), (u8)(rand() % 256), (u8)(rand() % 256)};
+        stress_ids[i] = spr_add(spr_mk(v2_mk(rand() % 780, rand() % 580),
+                                       v2_mk(4 + rand() % 16, 4 + rand() % 16), c));
+        stress_vel[i] = v2_mk((rand() % 9) - 4, (rand() % 9) - 4);
+    }
+    if (stress_c.texs) stress_tex_ini();
     
-    // Initialize particle system
     part_init();
+    for (u32 i = 0; i < stress_c.emits; i++) {
+        part_emit_add(v2_mk(rand() % 800, rand() % 600), v2_mk(1, 1), 2.0f,
+                      PART_DUST + i % 3, 1);
+    }
+}
+
+static void stress_upd(void)
+{
+    if (key(KEY_ESC)) e.rn = 0;
     
-    // Initialize texture usage
-    e.use_tex = 0;
+    // Bounce inside the window
+    for (u32 i = 0; i < stress_c.sprs; i++) {
+        spr* s = spr_get(stress_ids[i]);
+        if (!s) continue;
+        s->pos = v2_add(s->pos, stress_vel[i]);
+        if (s->pos.x < 0 || s->pos.x + s->sz.x > 800) stress_vel[i].x = -stress_vel[i].x;
+        if (s->pos.y < 0 || s->pos.y + s->sz.y > 600) stress_vel[i].y = -stress_vel[i].y;
+    }
     
-    // Open display
-    e.dpy = XOpenDisplay(NULL);
-    if (!e.dpy) {
-        fprintf(stderr, "Can't open display\n");
+    part_upd();
+}
+
+static void stress_drw(void)
+{
+    drw_bg();
+    
+    if (stress_c.texs) {
+        // One quarter of the textures is in use at a time, moving on every
+        // 60 frames, so a residency cap evicts the others
+        u32 q = (stress_c.texs + 3) / 4;
+        u32 beg = (e.fc / 60 % 4) * q;
+        for (u32 i = 0; i < stress_c.sprs; i++) {
+            spr* s = spr_get(stress_ids[i]);
+            if (!s) continue;
+            spr t = *s;
+            t.tex_id = stress_tex[beg + i % q < stress_c.texs ? beg + i % q : 0];
+            spr_drw_tex(t);
+        }
+    } else {
+        for (u32 i = 0; i < e.ns; i++) {
+            if (!e.sprs[i].stat) spr_drw(e.sprs[i]);
+        }
+    }
+    part_drw();
+    
+    char buf[64];
+    for (u32 i = 0; i < stress_c.texts; i++) {
+        snprintf(buf, sizeof(buf), "Line %u frame %u particles %u", i, e.fc, e.np);
+        v2 p = v2_mk(10, 20 + (i % 28) * 20);
+        if (e.def_font) {
+            font_drw(e.def_font, buf, p, (col){0, 0, 0}, FONT_LEFT);
+        } else {
+            drw_str(p, (col){0, 0, 0}, buf);
+        }
+    }
+}
+
+static void stress_fin(void)
+{
+    for (u32 i = 0; i < stress_c.sprs; i++) {
+        spr_del(stress_ids[i]);
+    }
+    part_clear();
+    
+    // Handed-off frames may still draw the textures
+    rnd_sync();
+    char path[64];
+    for (u32 i = 0; i < stress_c.texs; i++) {
+        tex_free(stress_tex[i]);
+        snprintf(path, sizeof(path), "%s/%u.bmp", stress_dir, i);
+        remove(path);
+    }
+    if (stress_c.texs) rmdir(stress_dir);
+    printf("Stress scene finished\n");
+}
+
+// Input recording, in the format described with inp_hdr
+static const char* inp_path;
+static FILE* inp_f;
+static inp_hdr inp_h;
+static u16 inp_keys;    // state as of the last record
+static u8 inp_btns;
+static s16 inp_x, inp_y;
+
+// Record to or replay from path; call before ini()
+void inp_use(u8 mode, const char* path)
+{
+    inp_mode = mode;
+    inp_path = path;
+}
+
+// Open the file and seed the RNG, before any scene runs
+static void inp_ini(void)
+{
+    if (!inp_mode) return;
+    
+    inp_f = fopen(inp_path, inp_mode == INP_REC ? "wb" : "rb");
+    if (!inp_f) {
+        fprintf(stderr, "Can't open input file: %s\n", inp_path);
+        inp_mode = 0;
+        return;
+    }
+    
+    if (inp_mode == INP_REC) {
+        inp_h.magic = INP_MAGIC;
+        inp_h.seed = (u32)tm_ns();
+        inp_h.frames = 0;
+        inp_h.ft = (u16)e.ft;
+        inp_h.ver = 1;
+        fwrite(&inp_h, sizeof(inp_h), 1, inp_f);
+    } else if (fread(&inp_h, sizeof(inp_h), 1, inp_f) != 1 ||
+               inp_h.magic != INP_MAGIC || inp_h.ver != 1 || !inp_h.frames || !inp_h.ft) {
+        // A recording cut short has no frame count
+        fprintf(stderr, "Not a complete input recording: %s\n", inp_path);
+        fclose(inp_f);
+        inp_f = NULL;
+        inp_mode = 0;
         return;
+    } else {
+        e.ft = inp_h.ft;
+    }
+    
+    srand(inp_h.seed);
+    printf("%s input %s (seed %u)\n", inp_mode == INP_REC ? "Recording" : "Replaying",
+           inp_path, inp_h.seed);
+}
+
+// Write this frame's input, or replace it with the recorded one
+static void inp_frame(void)
+{
+    if (inp_mode == INP_REC) {
+        u16 keys = 0;
+        for (u32 i = 0; i < 16; i++) keys |= (u16)(e.keys[i] != 0) << i;
+        u8 btns = (e.mouse_btns[0] != 0) | (e.mouse_btns[1] != 0) << 1 |
+                  (e.mouse_btns[2] != 0) << 2;
+        s16 x = (s16)e.mouse_pos.x, y = (s16)e.mouse_pos.y;
+        
+        u8 chg = (keys != inp_keys ? INP_KEYS : 0) | (btns != inp_btns ? INP_BTNS : 0) |
+                 (x != inp_x || y != inp_y ? INP_MOUSE : 0);
+        fputc(chg, inp_f);
+        if (chg & INP_KEYS) fwrite(&keys, sizeof(keys), 1, inp_f);
+        if (chg & INP_BTNS) fputc(btns, inp_f);
+        if (chg & INP_MOUSE) {
+            fwrite(&x, sizeof(x), 1, inp_f);
+            fwrite(&y, sizeof(y), 1, inp_f);
+        }
+        inp_keys = keys;
+        inp_btns = btns;
+        inp_x = x;
+        inp_y = y;
+        inp_h.frames++;
+    } else if (inp_mode == INP_PLAY) {
+        int chg = fgetc(inp_f);
+        u8 ok = chg != EOF;
+        if (ok && (chg & INP_KEYS)) ok = fread(&inp_keys, sizeof(inp_keys), 1, inp_f) == 1;
+        if (ok && (chg & INP_BTNS)) {
+            int b = fgetc(inp_f);
+            ok = b != EOF;
+            inp_btns = (u8)b;
+        }
+        if (ok && (chg & INP_MOUSE)) {
+            ok = fread(&inp_x, sizeof(inp_x), 1, inp_f) == 1 &&
+                 fread(&inp_y, sizeof(inp_y), 1, inp_f) == 1;
+        }
+        if (!ok) {
+            fprintf(stderr, "Input recording ended early\n");
+            e.rn = 0;
+        }
+        
+        for (u32 i = 0; i < 16; i++) e.keys[i] = (inp_keys >> i) & 1;
+        for (u32 i = 0; i < 3; i++) e.mouse_btns[i] = (inp_btns >> i) & 1;
+        e.mouse_pos = v2_mk(inp_x, inp_y);
+    }
+}
+
+static void inp_fin(void)
+{
+    if (!inp_f) return;
+    if (inp_mode == INP_REC) {
+        // Frame count goes in last, so a complete file is a valid one
+        fseek(inp_f, 0, SEEK_SET);
+        fwrite(&inp_h, sizeof(inp_h), 1, inp_f);
+        printf("Recorded %u frames of input\n", inp_h.frames);
     }
     
-    // Create window
+    // The next number from the RNG reflects every draw the run made, so
+    // a recording and its replays should agree on it
+    printf("Input %s check: rng %d\n", inp_mode == INP_REC ? "record" : "replay", rand());
+    fclose(inp_f);
+    inp_f = NULL;
+    inp_mode = 0;
+}
+
+// Create the window and its graphics context on e.dpy
+static void win_ini(void)
+{
     int s = DefaultScreen(e.dpy);
     e.wid = XCreateSimpleWindow(e.dpy, RootWindow(e.dpy, s),
                                10, 10, 800, 600, 1,
@@ -1295,11 +5235,53 @@ void ini(void)
                     GCForeground | GCBackground | GCLineWidth | GCLineStyle,
                     &gv);
     
+    // Start the render thread if pipelined
+    rnd_ini();
+    
     // Select events
     XSelectInput(e.dpy, e.wid, ExposureMask | KeyPressMask | KeyReleaseMask);
     
     // Map window
     XMapWindow(e.dpy, e.wid);
+}
+
+void ini(void)
+{
+    printf("Engine init\n");
+    PROF_THREAD("main");
+    
+    // Initialize resource manager
+    e.rm.ress = NULL;
+    e.rm.nr = 0;
+    e.rm.next_id = 1;
+    e.rm.hp = (hnd_pool){0};
+    
+    // Initialize scene manager
+    e.sm.scns = NULL;
+    e.sm.ns = 0;
+    e.sm.cur = 0;
+    e.sm.depth = 0;
+    e.sm.lvl = 0;
+    
+    // Initialize particle system
+    part_init();
+    
+    // Initialize texture usage
+    e.use_tex = 0;
+    
+    // Open display; stress and replay runs go on without one, discarding
+    // frames
+    e.dpy = XOpenDisplay(NULL);
+    if (!e.dpy && !stress_on && inp_mode != INP_PLAY) {
+        fprintf(stderr, "Can't open display\n");
+        return;
+    }
+    if (e.dpy) {
+        win_ini();
+    } else {
+        printf("No display, running headless\n");
+        e.pipe = 0;
+    }
     
     // Init timing
     e.lt = tm();
@@ -1311,157 +5293,450 @@ void ini(void)
     for (int i = 0; i < 16; i++) {
         e.keys[i] = 0;
     }
+    e.in_ns = 0;
+    e.in_lat = 0;
     
     // Init sprite system
     e.sprs = NULL;
     e.ns = 0;
+    e.sp = (hnd_pool){0};
     
-    // Create some test sprites and add to resource manager
-    col green = {0, 255, 0};
-    col blue = {0, 0, 255};
-    
-    // Platform
-    spr* platform = malloc(sizeof(spr));
-    *platform = spr_mk(v2_mk(300, 500), v2_mk(200, 20), green);
-    platform->id = res_add(platform, RES_SPR, "platform");
-    spr_add(*platform);
+    // Open asset pack and load default font
+    e.pak = pak_open("assets.pak");
+    e.def_font = e.pak ? pak_font(e.pak, "font") : 0;
+    if (!e.def_font) e.def_font = font_load("font.bmp", 8, 8, 32);
     
-    // Obstacles
-    spr* obstacle1 = malloc(sizeof(spr));
-    *obstacle1 = spr_mk(v2_mk(100, 400), v2_mk(50, 50), blue);
-    obstacle1->id = res_add(obstacle1, RES_SPR, "obstacle1");
-    spr_add(*obstacle1);
+    // Start worker pool and background loader
+    job_ini(0);
+    ld_ini();
     
-    spr* obstacle2 = malloc(sizeof(spr));
-    *obstacle2 = spr_mk(v2_mk(600, 300), v2_mk(50, 50), blue);
-    obstacle2->id = res_add(obstacle2, RES_SPR, "obstacle2");
-    spr_add(*obstacle2);
-    
-    // Load default font
-    e.def_font = font_load("font.bmp", 8, 8, 32);
+    // Hold the player texture for the engine lifetime so game scene
+    // entries hit the cache instead of reloading
+    player_tex_keep = scn_tex(&game_assets[0]);
     
     // Init audio
     aud_ini();
     
+    // Recorded runs fix the RNG seed before any scene starts
+    inp_ini();
+    
     // Add scenes
     scn_add(SCENE_MENU, menu_init, menu_upd, menu_drw, menu_fin);
     scn_add(SCENE_GAME, game_init, game_upd, game_drw, game_fin);
+    scn_add(SCENE_STRESS, stress_init, stress_upd, stress_drw, stress_fin);
+    scn_add(SCENE_PAUSE, pause_init, pause_upd, pause_drw, pause_fin);
+    scn_cover(SCENE_GAME, SCN_DRW_COVERED, game_suspend, game_resume);
+    scn_assets(SCENE_GAME, game_assets, sizeof(game_assets) / sizeof(game_assets[0]));
     
     // Set initial scene
-    scn_set(SCENE_MENU);
+    scn_set(stress_on ? SCENE_STRESS : SCENE_MENU);
     
-    e.win = 1;
+    e.win = e.dpy != NULL;
     e.rn = 1;
     
     printf("Window created\n");
-    printf("Sprites initialized: %u\n", e.ns);
     printf("Resources loaded: %u\n", e.rm.nr);
     printf("Scenes loaded: %u\n", e.sm.ns);
 }
 
-void run(void)
+// Performance overlay, drawn by the engine over whichever scene is active
+#define OVL_N 240       // frame times kept, one graph column each
+#define OVL_X 548
+#define OVL_Y 8
+#define OVL_H 60        // graph height, two frame budgets
+
+static u32 ovl_ft[OVL_N];   // frame intervals (us), oldest at ovl_i when full
+static u32 ovl_i, ovl_n;
+static u64 ovl_ns;          // start of the previous frame
+static u32 ovl_heap;        // heap_n at the previous frame
+
+static int ovl_cmp(const void* a, const void* b)
 {
-    if (!e.rn) return;
+    u32 x = *(const u32*)a, y = *(const u32*)b;
+    return (x > y) - (x < y);
+}
+
+// Record the interval since the last frame; kept while hidden so the
+// history is complete when the overlay opens
+static void ovl_tick(void)
+{
+    u64 now = tm_ns();
+    if (ovl_ns) {
+        ovl_ft[ovl_i] = (u32)((now - ovl_ns) / 1000);
+        ovl_i = (ovl_i + 1) % OVL_N;
+        if (ovl_n < OVL_N) ovl_n++;
+    }
+    ovl_ns = now;
+}
+
+// Snapshot the frame's counters before the overlay adds its own draws
+static void ovl_stats(void)
+{
+    u32 h = __atomic_load_n(&heap_n, __ATOMIC_RELAXED);
+    e.fs.draws = rnd_cur->n;
+    e.fs.xreqs = __atomic_load_n(&rnd_xreq, __ATOMIC_RELAXED);
+    e.fs.allocs = h - ovl_heap;
+    e.fs.parts = e.np;
+    e.fs.bytes = res_bytes(0) + e.fa.used;
+    for (u32 i = 0; i < SCN_STACK; i++) e.fs.bytes += e.sa[i].used;
+    ovl_heap = h;
+}
+
+static void ovl_rect(s32 x, s32 y, s32 w, s32 h, col clr)
+{
+    rcmd* c = rnd_add(RC_RECT);
+    if (!c) return;
+    c->clr = clr;
+    c->x = x;
+    c->y = y;
+    c->w = w;
+    c->h = h;
+}
+
+static void ovl_txt(s32 y, const char* s)
+{
+    col c = {255, 255, 255};
+    if (e.def_font) font_drw(e.def_font, s, v2_mk(OVL_X, y), c, FONT_LEFT);
+    else drw_str(v2_mk(OVL_X, y + 10), c, s);
+}
+
+static void ovl_drw(void)
+{
+    char buf[64];
+    u32 n = ovl_n;
+    u32 bud = e.ft * 1000;
+    col ok = {64, 200, 64}, slow = {230, 64, 64};
+    
+    ovl_rect(OVL_X - 4, OVL_Y - 4, OVL_N + 8, OVL_H + 8 + 8 * 16, (col){24, 24, 24});
+    
+    // Oldest frame on the left; frames over 1.5 budgets in red, drawn
+    // after the green ones so the color changes once
+    for (u8 pass = 0; pass < 2; pass++) {
+        for (u32 k = 0; k < n; k++) {
+            u32 ft = ovl_ft[(ovl_i + OVL_N - n + k) % OVL_N];
+            if ((ft * 2 > bud * 3) != pass) continue;
+            s32 h = bud ? (s32)((u64)ft * OVL_H / (2 * bud)) : OVL_H;
+            if (h > OVL_H) h = OVL_H;
+            if (h < 1) h = 1;
+            ovl_rect(OVL_X + OVL_N - n + k, OVL_Y + OVL_H - h, 1, h, pass ? slow : ok);
+        }
+    }
+    ovl_rect(OVL_X, OVL_Y + OVL_H / 2, OVL_N, 1, (col){200, 200, 64});
+    
+    // Nearest-rank percentiles over a sorted copy
+    u32 p50 = 0, p95 = 0, p99 = 0, mx = 0;
+    u32* st = n ? frame_alloc(n * sizeof(u32)) : NULL;
+    if (st) {
+        for (u32 k = 0; k < n; k++) st[k] = ovl_ft[k];
+        qsort(st, n, sizeof(u32), ovl_cmp);
+        p50 = st[(n * 50 + 99) / 100 - 1];
+        p95 = st[(n * 95 + 99) / 100 - 1];
+        p99 = st[(n * 99 + 99) / 100 - 1];
+        mx = st[n - 1];
+    }
+    
+    s32 y = OVL_Y + OVL_H + 6;
+    snprintf(buf, sizeof(buf), "p50 %.1f  p95 %.1f ms", p50 / 1000.0, p95 / 1000.0);
+    ovl_txt(y, buf);
+    snprintf(buf, sizeof(buf), "p99 %.1f  max %.1f ms", p99 / 1000.0, mx / 1000.0);
+    ovl_txt(y + 16, buf);
+    snprintf(buf, sizeof(buf), "draws %u  xreqs %u", e.fs.draws, e.fs.xreqs);
+    ovl_txt(y + 32, buf);
+    snprintf(buf, sizeof(buf), "parts %u  allocs %u", e.fs.parts, e.fs.allocs);
+    ovl_txt(y + 48, buf);
+    snprintf(buf, sizeof(buf), "mem %llu KB", (unsigned long long)(e.fs.bytes / 1024));
+    ovl_txt(y + 64, buf);
+    snprintf(buf, sizeof(buf), "input %.2f ms", e.in_lat / 1000.0);
+    ovl_txt(y + 80, buf);
+    
+    // Resource memory against the budget, and the largest consumer
+    if (e.rm.budget) {
+        snprintf(buf, sizeof(buf), "res %llu/%llu KB%s", (unsigned long long)(res_bytes(0) / 1024),
+                 (unsigned long long)(e.rm.budget / 1024), e.rm.over ? " OVER" : "");
+    } else {
+        snprintf(buf, sizeof(buf), "res %llu KB", (unsigned long long)(res_bytes(0) / 1024));
+    }
+    ovl_txt(y + 96, buf);
+    u32 top;
+    if (res_top(&top, 1)) {
+        const res* r = &e.rm.ress[hnd_idx(&e.rm.hp, top)];
+        snprintf(buf, sizeof(buf), "top %s %u KB", r->name, r->sz / 1024);
+        ovl_txt(y + 112, buf);
+    }
+}
 
+// Read queued X events, stamping input with its arrival time
+static void evt_drain(void)
+{
     XEvent ev;
+    
+    while (XPending(e.dpy)) {
+        XNextEvent(e.dpy, &ev);
+        u64 now = tm_ns();
 
-    while (e.rn) {
-        // Handle events
-        while (XPending(e.dpy)) {
-            XNextEvent(e.dpy, &ev);
-
-            switch (ev.type) {
-                case KeyPress:
-                case KeyRelease: {
-                    KeySym ks = XLookupKeysym(&ev.xkey, 0);
-                    u8 k = xk(ks);
-                    if (k) {
-                        e.keys[k] = (ev.type == KeyPress);
-                        if (k == KEY_ESC && ev.type == KeyPress && e.sm.cur == SCENE_MENU) {
-                            e.rn = 0;
-                        }
+        switch (ev.type) {
+            case KeyPress:
+            case KeyRelease: {
+                KeySym ks = XLookupKeysym(&ev.xkey, 0);
+                u8 k = xk(ks);
+                if (k) {
+                    // F toggles the overlay on press, not on auto-repeat
+                    if (k == KEY_F && ev.type == KeyPress && !e.keys[k]) {
+                        e.ovl = !e.ovl;
                     }
-                    break;
-                }
-                case ButtonPress:
-                case ButtonRelease: {
-                    u8 state = (ev.type == ButtonPress);
-                    switch (ev.xbutton.button) {
-                        case Button1: e.mouse_btns[0] = state; break;
-                        case Button2: e.mouse_btns[1] = state; break;
-                        case Button3: e.mouse_btns[2] = state; break;
+                    e.keys[k] = (ev.type == KeyPress);
+                    if (!e.in_ns) e.in_ns = now;
+                    if (k == KEY_ESC && ev.type == KeyPress && e.sm.depth &&
+                        e.sm.scns[e.sm.cur].id == SCENE_MENU) {
+                        e.rn = 0;
                     }
-                    break;
+#ifdef PROF
+                    // T writes the zones recorded so far
+                    if (k == KEY_T && ev.type == KeyPress) prof_dump("trace.json");
+#endif
                 }
-                case MotionNotify: {
-                    e.mouse_pos.x = ev.xmotion.x;
-                    e.mouse_pos.y = ev.xmotion.y;
-                    break;
+                break;
+            }
+            case ButtonPress:
+            case ButtonRelease: {
+                u8 state = (ev.type == ButtonPress);
+                switch (ev.xbutton.button) {
+                    case Button1: e.mouse_btns[0] = state; break;
+                    case Button2: e.mouse_btns[1] = state; break;
+                    case Button3: e.mouse_btns[2] = state; break;
                 }
+                if (!e.in_ns) e.in_ns = now;
+                break;
+            }
+            case MotionNotify: {
+                e.mouse_pos.x = ev.xmotion.x;
+                e.mouse_pos.y = ev.xmotion.y;
+                if (!e.in_ns) e.in_ns = now;
+                break;
             }
         }
+    }
+}
+
+// Update, record and rasterize one frame; ph, if given, accumulates the
+// ns spent updating, recording and rasterizing (or handing off)
+static void frame(u64* ph)
+{
+    PROF_BEG("frame");
+    u64 t0 = tm_ns();
 
-        // Timing
-        e.ct = tm();
-        e.dt = e.ct - e.lt;
+    // Timing; replays step by the recorded frame time
+    e.ct = inp_mode == INP_PLAY ? e.lt + e.ft : tm();
+    e.dt = e.ct - e.lt;
+    e.lt = e.ct;
+    e.fc++;
+    ovl_tick();
 
-        if (e.dt >= e.ft) {
-            e.lt = e.ct;
-            e.fc++;
+    // Frame scratch memory starts empty
+    arena_reset(&e.fa);
 
-            // Update current scene
-            scn_upd();
+    // Publish finished background loads, then evict what the cap
+    // could not take back while those frames were in flight
+    ld_poll();
+    tex_trim(0);
 
-            // Draw current scene
-            scn_drw();
+    // Input-to-update latency of this frame's oldest input
+    if (e.in_ns) {
+        e.in_lat = (u32)((tm_ns() - e.in_ns) / 1000);
+        e.in_ns = 0;
+    }
 
-            // Calculate actual FPS every second
-            if (e.fc % 60 == 0) {
-                u32 ct = tm();
-                u32 elapsed = ct - (e.lt - e.dt);
-                if (elapsed > 0) {
-                    e.fps = (60 * 1000) / elapsed;
-                }
-            }
+    // Record or replay this frame's input
+    inp_frame();
+
+    // Update current scene, then switch if a prepared scene is due
+    scn_upd();
+    scn_poll();
+    u64 t1 = tm_ns();
+
+    // Record the current scene and rasterize it (on the render
+    // thread when pipelined, overlapping the next update)
+    scn_drw();
+    ovl_stats();
+    if (e.ovl) ovl_drw();
+    u64 t2 = tm_ns();
+    rnd_frame();
+    PROF_END();
+
+    if (ph) {
+        ph[0] += t1 - t0;
+        ph[1] += t2 - t1;
+        ph[2] += tm_ns() - t2;
+    }
+}
+
+// Run n frames back to back and report throughput
+static void run_unpaced(u32 n)
+{
+    u32* ft = malloc(n * sizeof(u32));  // frame times (us)
+    u64 ph[3] = {0};
+    u32 f = 0;
+    u64 beg = tm_ns();
+    
+    for (; f < n && e.rn; f++) {
+        if (e.dpy) evt_drain();
+        u64 t = tm_ns();
+        frame(ph);
+        if (ft) ft[f] = (u32)((tm_ns() - t) / 1000);
+    }
+    
+    // Count the handed-off frames' drawing too
+    rnd_sync();
+    f64 secs = (tm_ns() - beg) / 1e9;
+    if (!f) {
+        free(ft);
+        return;
+    }
+    
+    printf("%s: %u frames (%u drawn) in %.2f s, %.1f FPS\n",
+           stress_on ? "Stress" : "Replay", f, __atomic_load_n(&rnd_drawn, __ATOMIC_RELAXED), secs, f / secs);
+    printf("  per frame: update %.3f ms, record %.3f ms, %s %.3f ms\n",
+           ph[0] / 1e6 / f, ph[1] / 1e6 / f, e.pipe ? "hand-off" : e.dpy ? "rasterize" : "discard",
+           ph[2] / 1e6 / f);
+    if (ft) {
+        qsort(ft, f, sizeof(u32), ovl_cmp);
+        printf("  frame time: p50 %.3f, p99 %.3f, max %.3f ms\n",
+               ft[(f * 50 + 99) / 100 - 1] / 1e3, ft[(f * 99 + 99) / 100 - 1] / 1e3,
+               ft[f - 1] / 1e3);
+        free(ft);
+    }
+    printf("  %u sprites, %u particles\n", e.ns, e.np);
+    if (e.rm.tex_cap) {
+        printf("  textures: %llu KB resident, cap %llu KB, %u evictions, %u reloads\n",
+               (unsigned long long)(res_bytes(RES_TEX) / 1024),
+               (unsigned long long)(e.rm.tex_cap / 1024), e.rm.evicts, e.rm.reloads);
+    }
+}
+
+void run(void)
+{
+    if (!e.rn) return;
+    
+    // Stress and replay runs measure throughput, so they skip pacing
+    if (stress_on || inp_mode == INP_PLAY) {
+        run_unpaced(stress_on ? stress_c.frames : inp_h.frames);
+        return;
+    }
+
+    // Frame clock: a periodic timerfd keeps the cadence without drift.
+    // Without one, poll times out at the next deadline instead
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd >= 0) {
+        struct itimerspec its;
+        its.it_interval.tv_sec = 0;
+        its.it_interval.tv_nsec = e.ft * 1000000L;
+        its.it_value = its.it_interval;
+        if (timerfd_settime(tfd, 0, &its, NULL) < 0) {
+            close(tfd);
+            tfd = -1;
+        }
+    }
+    
+    struct pollfd pfd[2];
+    pfd[0].fd = ConnectionNumber(e.dpy);
+    pfd[0].events = POLLIN;
+    pfd[1].fd = tfd;
+    pfd[1].events = POLLIN;
+    u32 fps_t = tm();
+
+    while (e.rn) {
+        // Handle events, including any Xlib queued while drawing, since
+        // poll only sees what is still on the socket
+        evt_drain();
+        if (!e.rn) break;
+        
+        // Sleep until input arrives or a frame is due
+        s32 wait = -1;
+        if (tfd < 0) {
+            u32 el = tm() - e.lt;
+            wait = el < e.ft ? (s32)(e.ft - el) : 0;
+        }
+        if (poll(pfd, tfd >= 0 ? 2 : 1, wait) < 0 && errno != EINTR) break;
+        
+        u8 due;
+        if (tfd >= 0) {
+            u64 n;
+            due = (pfd[1].revents & POLLIN) && read(tfd, &n, sizeof(n)) == sizeof(n);
+        } else {
+            due = tm() - e.lt >= e.ft;
         }
+        if (!due) continue;
+        
+        // Input that raced the timer still makes this frame
+        evt_drain();
+        frame(NULL);
 
-        // Small sleep to prevent CPU hogging
-        struct timespec ts;
-        ts.tv_sec = 0;
-        ts.tv_nsec = 1000000; // 1 millisecond
-        nanosleep(&ts, NULL);
+        // Calculate actual FPS every second
+        if (e.fc % 60 == 0) {
+            u32 ct = tm();
+            if (ct > fps_t) {
+                e.fps = (60 * 1000) / (ct - fps_t);
+            }
+            fps_t = ct;
+        }
     }
+    
+    if (tfd >= 0) close(tfd);
 }
 
 
 void fin(void)
 {
-    // Finish current scene
-    if (e.sm.cur < e.sm.ns && e.sm.scns[e.sm.cur].fin) {
-        e.sm.scns[e.sm.cur].fin();
-    }
+    // Stop rendering before the scene frees what frames reference
+    rnd_fin();
+    
+    // Finish every scene on the stack
+    scn_clear();
+    ecs_fin();
     
     // Free scenes
     if (e.sm.scns) {
         free(e.sm.scns);
+        e.sm.scns = NULL;
+        e.sm.ns = e.sm.cap = 0;
         printf("Scenes freed\n");
     }
     
     // Free sprites
     if (e.sprs) {
         free(e.sprs);
+        e.sprs = NULL;
+        e.ns = 0;
+        hnd_free(&e.sp);
         printf("Sprites freed\n");
     }
     
-    // Clear particles
+    // Free particles
     part_clear();
+    free(e.parts);
+    free(e.emits);
+    e.parts = NULL;
+    e.emits = NULL;
+    e.pcap = e.ecap = 0;
     
-    // Clear all resources
-    res_clear();
+    // Free arenas
+    arena_fin(&e.fa);
+    for (u32 i = 0; i < SCN_STACK; i++) arena_fin(&e.sa[i]);
+    
+    // Stop worker pool and background loader
+    job_fin();
+    ld_fin();
     
-    // Shutdown audio
+    // Shutdown audio (voices reference sound resources)
     aud_fin();
     
+    // Release a pending preparation, then all resources
+    scn_unprep();
+    res_clear();
+    
+    // Close the input recording
+    inp_fin();
+    
     if (e.gc) {
         XFreeGC(e.dpy, e.gc);
         printf("GC freed\n");
@@ -1473,6 +5748,10 @@ void fin(void)
         printf("Window destroyed\n");
     }
     
+#ifdef PROF
+    prof_fin();
+#endif
+    
     printf("Engine shutdown\n");
     e.rn = 0;
 }
@@ -8,6 +8,8 @@ typedef unsigned short u16;
 typedef signed short s16;
 typedef unsigned int u32;
 typedef signed int s32;
+typedef unsigned long long u64;
+typedef signed long long s64;
 typedef float f32;
 typedef double f64;
 
@@ -23,6 +25,7 @@ typedef double f64;
 #define KEY_P 0x09
 #define KEY_B 0x0A
 #define KEY_F 0x0B
+#define KEY_T 0x0F
 
 // Mouse codes
 #define MOUSE_LEFT 0x0C
@@ -34,15 +37,48 @@ typedef double f64;
 #define SND_HIT 0x02
 #define SND_CLICK 0x03
 
+// Audio outputs
+#define AUD_ALSA 0x01
+#define AUD_NULL 0x02
+#define AUD_WAV 0x03
+
+// Input recording modes
+#define INP_REC 0x01
+#define INP_PLAY 0x02
+
+// Synth waveforms
+#define SYN_SIN 0x01
+#define SYN_SQR 0x02
+#define SYN_SAW 0x03
+#define SYN_TRI 0x04
+#define SYN_NOISE 0x05
+
+// Mixing kernels
+#define MIX_SCALAR 0x00
+#define MIX_SSE2 0x01
+#define MIX_AVX2 0x02
+
 // Resource types
 #define RES_SPR 0x01
 #define RES_SND 0x02
 #define RES_TEX 0x03
 #define RES_FONT 0x04
+#define RES_PAK 0x05
+#define RES_MUS 0x06
 
 // Scene types
 #define SCENE_MENU 0x01
 #define SCENE_GAME 0x02
+#define SCENE_STRESS 0x03
+#define SCENE_PAUSE 0x04
+
+// What a scene keeps doing while another is pushed over it
+#define SCN_UPD_COVERED 0x01
+#define SCN_DRW_COVERED 0x02
+
+// Scene transition effects
+#define SCN_FX_NONE 0x00
+#define SCN_FX_WIPE 0x01 // black curtain drawn back over the new scene
 
 // Particle types
 #define PART_DUST 0x01
@@ -54,6 +90,17 @@ typedef double f64;
 #define FONT_CENTER 0x02
 #define FONT_RIGHT 0x03
 
+// Asset pack file (pak_hdr, entry data, pak_ent index table; little-endian)
+#define PAK_MAGIC 0x4B415047 // "GPAK"
+#define PAK_VER 1
+#define PAK_ALIGN 16
+
+// Handle pool: handle = generation << HND_IDX_BITS | slot, 0 is never valid
+#define HND_IDX_BITS 20
+#define HND_IDX_MASK ((1u << HND_IDX_BITS) - 1)
+#define HND_GEN_MASK ((1u << (32 - HND_IDX_BITS)) - 1)
+#define HND_NONE 0xFFFFFFFFu
+
 // Vector types
 typedef struct { f32 x, y; } v2;
 typedef struct { f32 x, y, z; } v3;
@@ -68,6 +115,7 @@ typedef struct {
     v2 sz;
     col clr;
     u8 vis;
+    u8 stat;    // baked into the background layer; set before spr_add
     u32 id;
     u32 tex_id; // Texture ID
 } spr;
@@ -79,6 +127,11 @@ typedef struct {
     u32 h;
     col* data;
     u8 loaded;
+    u8 mapped;  // data lives in a pack mapping
+    u8 evicted; // data dropped by the residency cap, reloads on tex_get
+    u8 failed;  // async load failed, stays a placeholder
+    u32 last;   // frame last used
+    char* path; // source file, NULL if it cannot be reloaded
 } tex;
 
 // Font character data
@@ -97,6 +150,7 @@ typedef struct {
     u8 num_chars;
     font_char* chars;
     u8 loaded;
+    u8 mapped;  // glyph data lives in a pack mapping
 } font;
 
 // Particle type
@@ -129,28 +183,226 @@ typedef struct {
     u32 rate;
     u8 ch;
     u32 id;
+    u8 mapped;  // samples live in a pack mapping
 } snd;
 
+// Synth patch
+typedef struct {
+    u8 wave;     // SYN_*
+    f32 hz;      // start frequency
+    f32 hz_end;  // end frequency for a linear sweep, 0 = constant
+    f32 amp;     // peak amplitude 0..1
+    f32 atk;     // attack seconds
+    f32 dec;     // decay seconds
+    f32 sus;     // sustain level 0..1
+    f32 rel;     // release seconds (at the end of the note)
+} syn;
+
+// Synth voice state; rendering can resume at any sample
+typedef struct {
+    syn p;
+    u32 pos;     // samples rendered
+    u32 len;     // total samples
+    u32 phase;   // oscillator phase, full turn = 2^32
+    f32 inc;     // phase increment per sample
+    f32 dinc;    // increment change per sample (sweep)
+    u32 rng;     // noise state
+    u32 atk, dec, rel; // envelope segments in samples
+} syn_st;
+
+// Asset pack header
+typedef struct {
+    u32 magic;
+    u32 ver;
+    u32 n;       // number of entries
+    u32 idx_off; // offset of the pak_ent table
+} pak_hdr;
+
+// Asset pack index entry, a..d depend on type:
+//   RES_TEX:  a = w, b = h                      data = w * h col
+//   RES_FONT: a = cw, b = ch, c = first_char,
+//             d = num_chars                     data = num_chars * cw * ch u8 (0/1)
+//   RES_SND:  a = len, b = rate, c = ch         data = len * ch s16
+typedef struct {
+    char name[16];
+    u32 type;
+    u32 off;
+    u32 size;
+    u32 a, b, c, d;
+} pak_ent;
+
+// Input recording file: this header, then one record per frame holding a
+// change mask and only the fields that changed (u16 key bits by KEY_*,
+// u8 mouse buttons, s16 x and y), so idle frames cost one byte
+#define INP_MAGIC 0x504E4947 // "GINP"
+#define INP_KEYS 0x01
+#define INP_BTNS 0x02
+#define INP_MOUSE 0x04
+
+typedef struct {
+    u32 magic;
+    u32 seed;   // srand() seed of the recorded run
+    u32 frames; // written on close
+    u16 ft;     // frame time (ms), the replay's fixed timestep
+    u16 ver;
+} inp_hdr;
+
+// Mapped asset pack
+typedef struct {
+    u8* base;
+    u32 size;
+    const pak_ent* ents;
+    u32 n;
+} pak;
+
+// Streamed music track: a mapped 16-bit PCM WAV read period by period
+typedef struct {
+    u8* base;       // file mapping
+    u32 size;
+    const s16* data; // samples inside the mapping
+    u32 len;        // frames
+    u8 ch;
+    u32 loop_beg;   // loop start frame
+    u32 loop_end;   // loop end frame, 0 = play once
+} mus;
+
+// Handle pool (slot map over a caller-owned dense array), zero-init is empty
+typedef struct {
+    u32* gen;   // generation per slot
+    u32* idx;   // slot -> dense index, or next free slot + 1
+    u32* dns;   // dense index -> slot
+    u32 cap;    // allocated slots
+    u32 top;    // slots ever used
+    u32 n;      // live handles (dense count)
+    u32 free;   // free slot list head + 1 (0 = empty)
+} hnd_pool;
+
+// Linear arena; everything allocated is released together by arena_reset
+typedef struct arena_blk arena_blk;
+
+typedef struct {
+    arena_blk* blk; // current block, chained to older ones
+    u32 used;       // bytes allocated since last reset
+} arena;
+
 // Resource entry
 typedef struct {
-    u32 id;
+    u32 id;     // handle
     u8 type;
     void* data;
     char name[16];
+    u32 refs;   // reference count
+    char* key;  // cache key (source path), NULL if uncached
+    s64 mtime;  // source file mtime
+    u32 next;   // next handle in cache bucket
+    u32 sz;     // bytes held in process memory
 } res;
 
 // Resource manager
+#define RES_BUCKETS 64
+#define RES_TYPES 8 // resource type codes are below this
+
+// Called when the resource budget is first exceeded
+typedef void (*res_warn_fn)(u64 used, u64 budget);
+
 typedef struct {
-    res* ress;
+    res* ress;     // dense, indexed through hp
     u32 nr;
     u32 next_id;
+    hnd_pool hp;   // resource handles
+    u32 cache[RES_BUCKETS]; // path cache bucket heads
+    u64 bytes[RES_TYPES];   // bytes held per type
+    u64 total;     // bytes held by all resources
+    u64 budget;    // 0 = unlimited
+    u64 tex_cap;   // texture residency cap, 0 = unlimited
+    u32 evicts;    // textures dropped by the residency cap
+    u32 reloads;   // evicted textures read back on use
+    res_warn_fn warn;
+    u8 over;       // budget currently exceeded
 } res_mgr;
 
+// Audio output counters (ns timings), updated by the audio thread
+typedef struct {
+    u8 out;          // AUD_* output in use
+    u32 periods;     // periods written
+    u32 underruns;   // output ran dry
+    u32 plays;       // voices started
+    u32 mix_ns;      // mixer CPU time, last period
+    u32 mix_ns_max;
+    u64 mix_ns_sum;
+    u32 lat_ns;      // trigger-to-output latency, last voice
+    u32 lat_ns_max;
+    u64 lat_ns_sum;
+} aud_stats;
+
+// Mixing kernel: add n mono samples scaled by Q15 gains to planar s32
+// left/right accumulators
+typedef void (*mix_fn)(s32* l, s32* r, const s16* src, u32 n, s32 gl, s32 gr);
+
+// Per-frame counters shown by the performance overlay
+typedef struct {
+    u32 draws;  // draw commands recorded
+    u32 xreqs;  // X requests of the last rasterized frame
+    u32 allocs; // heap allocations made by the engine (malloc/realloc)
+    u32 parts;  // live particles
+    u64 bytes;  // resource and arena bytes in use
+} frm_stats;
+
+// Stress mode content and length
+typedef struct {
+    u32 sprs;   // moving sprites
+    u32 emits;  // particle emitters, one particle each per frame
+    u32 texts;  // text lines drawn per frame
+    u32 frames; // frames to run, unpaced
+    u32 texs;   // generated textures; a quarter of them in use at a time
+} stress_cfg;
+
+// Job system: job callbacks; range jobs get a slice [beg, end) of a parallel-for
+typedef void (*job_fn)(void* arg);
+typedef void (*job_for_fn)(void* arg, u32 beg, u32 end);
+
+// Count of unfinished jobs, zero-init; jobs may wait on it or follow it
+typedef struct {
+    u32 n;
+} job_ctr;
+
+// Entity-component store: entities with the same component set share an
+// archetype, whose chunks hold ECS_CHUNK entities as one array per component
+#define ECS_COMPS 32
+#define ECS_CHUNK 256
+#define ECS_SPARE 256  // entities ecs_new can create during one ecs_each_par
+#define ECS_NONE 0xFFFFFFFFu // ecs_comp found no free id; callers must check
+#define ECS_BIT(c) ((c) < ECS_COMPS ? (ecs_mask)1 << (c) : 0)
+typedef u32 ecs_ent;   // handle, 0 = none
+typedef u32 ecs_mask;  // one bit per component id
+
+// One chunk of a query: n entities, columns indexed by component id
+// (NULL for components the archetype lacks)
+typedef struct {
+    u32 n;
+    const ecs_ent* ents;
+    void* col[ECS_COMPS];
+} ecs_view;
+
+#define ECS_COL(v, type, c) ((type*)(v)->col[c])
+
+// System callback, run once per matching chunk
+typedef void (*ecs_fn)(ecs_view* v, void* arg);
+
 // Scene functions
 typedef void (*scn_init_fn)(void);
 typedef void (*scn_upd_fn)(void);
 typedef void (*scn_drw_fn)(void);
 typedef void (*scn_fin_fn)(void);
+typedef void (*scn_sus_fn)(void);   // covered by a pushed scene
+typedef void (*scn_res_fn)(void);   // uncovered again
+
+// Texture a scene needs before it starts: an asset pack entry if a pack is
+// open and has it, else a file
+typedef struct {
+    const char* name;
+    const char* path;
+} scn_asset;
 
 // Scene
 typedef struct {
@@ -159,14 +411,33 @@ typedef struct {
     scn_upd_fn upd;
     scn_drw_fn drw;
     scn_fin_fn fin;
-    u8 active;
+    u8 active;  // on the stack
+    const scn_asset* assets; // loaded before init, see scn_prep
+    u32 na;
+    u8 flags;   // SCN_UPD_COVERED, SCN_DRW_COVERED
+    scn_sus_fn suspend;
+    scn_res_fn resume;
 } scn;
 
+#define SCN_PREP 16 // assets held for a scene being prepared
+#define SCN_STACK 8 // deepest scene stack
+
 // Scene manager
 typedef struct {
     scn* scns;
     u32 ns;
-    u32 cur;
+    u32 cur;    // top of the stack (index into scns)
+    u32 cap;    // allocated scenes
+    u32 stack[SCN_STACK]; // scene indices, bottom first
+    u32 depth;
+    u32 gen;    // bumped by every stack change
+    u32 lvl;    // stack level whose callback is running
+    u32 next;   // scene being prepared, 0 = none
+    u8 go;      // switch to next once prepared
+    u8 fx;      // transition effect of the pending switch
+    u32 fx_f;   // frames left of the running effect
+    u32 prep[SCN_PREP]; // texture handles held while preparing
+    u32 np;
 } scn_mgr;
 
 // Engine state
@@ -184,29 +455,71 @@ typedef struct {
     u32 fc;     // frame counter
     u32 ft;     // frame time
     u8 keys[16]; // key states
+    u64 in_ns;  // arrival of the oldest input not yet updated, 0 = none
+    u32 in_lat; // input-to-update latency of the last input (us)
     u8 mouse_btns[3]; // mouse button states
     v2 mouse_pos;     // mouse position
-    spr* sprs;  // sprite array
+    spr* sprs;  // sprite array (dense)
     u32 ns;     // number of sprites
+    hnd_pool sp; // sprite handles
     part* parts; // particles array
     u32 np;     // number of particles
+    u32 pcap;   // allocated particles
     part_emit* emits; // particle emitters
     u32 ne;     // number of emitters
+    u32 ecap;   // allocated emitters
     void* ahan; // audio handle
     res_mgr rm; // resource manager
     scn_mgr sm; // scene manager
     u8 use_tex; // use textures
     u32 def_font; // default font ID
+    u32 pak;    // asset pack ID
+    arena fa;   // frame scratch arena, reset every frame
+    arena sa[SCN_STACK]; // scene arenas, one per stack level, reset when it is left
+    u8 pipe;    // update and render on separate threads
+    u8 ovl;     // performance overlay shown
+    frm_stats fs; // counters of the last frame
 } eng_t;
 
+// Profiler zones. Build with -DPROF (make PROF=1) to record them into
+// per-thread rings; otherwise they compile to nothing
+#ifdef PROF
+#define PROF_BEG(name) prof_beg(name)
+#define PROF_END() prof_end()
+#define PROF_THREAD(name) prof_thread(name)
+void prof_beg(const char* name);
+void prof_end(void);
+void prof_thread(const char* name);
+u8 prof_dump(const char* path);
+#else
+#define PROF_BEG(name) ((void)0)
+#define PROF_END() ((void)0)
+#define PROF_THREAD(name) ((void)0)
+#endif
+
 // Engine functions
 void ini(void);
 void run(void);
 void fin(void);
+void stress_use(const stress_cfg* c);
+void inp_use(u8 mode, const char* path);
 u8 key(u8 k);
 u8 mouse_btn(u8 btn);
 v2 v2_mouse(void);
 
+// Arena functions
+void* arena_alloc(arena* a, u32 sz);
+void arena_reset(arena* a);
+void arena_fin(arena* a);
+void* frame_alloc(u32 sz);
+void* scn_alloc(u32 sz);
+
+// Handle pool functions
+u32 hnd_new(hnd_pool* p);
+u32 hnd_idx(const hnd_pool* p, u32 h);
+u32 hnd_del(hnd_pool* p, u32 h);
+void hnd_free(hnd_pool* p);
+
 // Vector functions
 v2 v2_mk(f32 x, f32 y);
 v2 v2_add(v2 a, v2 b);
@@ -217,9 +530,19 @@ f32 v2_len(v2 a);
 v2 v2_nrm(v2 a);
 f32 v2_dot(v2 a, v2 b);
 
+// Render functions (draw calls record; frames rasterize after scn_drw)
+void rnd_pipe(u8 on);
+void rnd_sync(void);
+void rnd_drop(void);
+void drw_clear(void);
+void drw_bg(void);
+void drw_bg_set(const spr* s, u32 n);
+void drw_str(v2 pos, col clr, const char* s);
+
 // Sprite functions
 spr spr_mk(v2 pos, v2 sz, col clr);
-void spr_add(spr s);
+u32 spr_add(spr s);
+void spr_del(u32 id);
 void spr_drw(spr s);
 void spr_drw_tex(spr s);
 u8 spr_col(spr a, spr b);
@@ -227,9 +550,12 @@ spr* spr_get(u32 id);
 
 // Texture functions
 u32 tex_load(const char* path);
+u32 tex_load_async(const char* path);
+u8 tex_ready(u32 id);
 void tex_drw(u32 id, v2 pos, v2 sz);
 tex* tex_get(u32 id);
 void tex_free(u32 id);
+void tex_budget(u64 bytes);
 
 // Font functions
 u32 font_load(const char* path, u8 cw, u8 ch, u8 first_char);
@@ -238,6 +564,44 @@ void font_free(u32 id);
 font* font_get(u32 id);
 u32 font_text_width(u32 id, const char* text);
 
+// Asset pack functions
+u32 pak_open(const char* path);
+void pak_close(u32 id);
+const pak_ent* pak_find(u32 id, const char* name);
+u32 pak_tex(u32 id, const char* name);
+u32 pak_font(u32 id, const char* name);
+u32 pak_snd(u32 id, const char* name);
+
+// Job functions (work-stealing pool; the main thread is worker 0)
+void job_ini(u32 nthr);
+void job_fin(void);
+u32 job_threads(void);
+void job_run(job_fn fn, void* arg, job_ctr* ctr);
+void job_after(job_fn fn, void* arg, job_ctr* dep, job_ctr* ctr);
+void job_for(job_for_fn fn, void* arg, u32 n, u32 grain, job_ctr* ctr);
+void job_wait(job_ctr* ctr);
+
+// ECS functions. While a query runs, structural changes (new, del, add,
+// rem) are queued and applied when the outermost query returns; systems
+// run by ecs_each_par may queue them but should touch other entities only
+// through their view, and get their new handles from a spare set (ecs_new
+// returns 0 once ECS_SPARE are used). Spares do not count as alive, and
+// ecs_clear deletes every entity and releases them
+u32 ecs_comp(u32 size);
+ecs_ent ecs_new(ecs_mask m);
+void ecs_del(ecs_ent en);
+void ecs_add(ecs_ent en, u32 c, const void* val);
+void ecs_rem(ecs_ent en, u32 c);
+void ecs_set(ecs_ent en, u32 c, const void* val);
+void* ecs_get(ecs_ent en, u32 c);
+u8 ecs_alive(ecs_ent en);
+u32 ecs_count(ecs_mask all);
+void ecs_each(ecs_mask all, ecs_fn fn, void* arg);
+void ecs_each_par(ecs_mask all, ecs_fn fn, void* arg);
+void ecs_flush(void);
+void ecs_clear(void);
+void ecs_fin(void);
+
 // Particle functions
 void part_init(void);
 void part_add(v2 pos, v2 vel, col clr, f32 life, u8 type);
@@ -247,21 +611,52 @@ void part_drw(void);
 void part_clear(void);
 
 // Audio functions
+void aud_use(u8 out, const char* path);
 void aud_ini(void);
+void aud_stat(aud_stats* st);
 void aud_play(u8 s);
+void aud_play_ex(u8 s, f32 gain, f32 pan);
 void aud_fin(void);
+void aud_play_syn(const syn* p, u32 ms, f32 gain, f32 pan);
+mix_fn mix_get(u8 kind);
+void mix_out(s16* out, const s32* l, const s32* r, u32 n);
 snd* snd_get(u32 id);
 
+// Music streaming functions
+u32 mus_open(const char* path);
+void mus_loop(u32 id, u32 beg, u32 end);
+void mus_play(u32 id, f32 gain);
+void mus_stop(u32 id);
+void mus_close(u32 id);
+
+// Synth functions
+void syn_start(syn_st* st, const syn* p, u32 ms, u32 rate);
+u32 syn_gen(syn_st* st, s16* out, u32 n);
+u32 snd_syn(const syn* p, u32 ms, const char* name);
+
 // Resource functions
 u32 res_add(void* data, u8 type, const char* name);
 void* res_get(u32 id);
 void* res_find(const char* name);
+void res_retain(u32 id);
+void res_release(u32 id);
 void res_del(u32 id);
 void res_clear(void);
+void res_budget(u64 bytes, res_warn_fn warn);
+u64 res_bytes(u8 type);
+u32 res_top(u32* ids, u32 n);
+void res_warn_top(u64 used, u64 budget);
 
 // Scene functions
 void scn_add(u32 id, scn_init_fn init, scn_upd_fn upd, scn_drw_fn drw, scn_fin_fn fin);
 void scn_set(u32 id);
+void scn_push(u32 id);
+void scn_pop(void);
+void scn_replace(u32 id);
+void scn_cover(u32 id, u8 flags, scn_sus_fn suspend, scn_res_fn resume);
+void scn_assets(u32 id, const scn_asset* a, u32 n);
+void scn_prep(u32 id);
+void scn_go(u32 id, u8 fx);
 void scn_upd(void);
 void scn_drw(void);
 
@@ -1,7 +1,41 @@
 #include "eng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-int main(void)
+int main(int argc, char** argv)
 {
+    // --audio=null, --audio=wav[:file.wav] pick a non-ALSA output,
+    // --pipe overlaps update and rendering on two threads,
+    // --stress[=sprites,emitters,texts,frames,textures] runs an unpaced load test,
+    // --record=file saves per-frame input, --replay=file plays it back unpaced,
+    // --res-budget=KB warns with the largest resources once asset memory exceeds KB,
+    // --tex-budget=KB keeps resident texture pixels under KB, reloading on use
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pipe") == 0) {
+            rnd_pipe(1);
+        } else if (strcmp(argv[i], "--audio=null") == 0) {
+            aud_use(AUD_NULL, NULL);
+        } else if (strncmp(argv[i], "--audio=wav", 11) == 0) {
+            aud_use(AUD_WAV, argv[i][11] == ':' ? argv[i] + 12 : NULL);
+        } else if (strncmp(argv[i], "--stress", 8) == 0) {
+            stress_cfg c = {1000, 20, 20, 1000, 0};
+            if (argv[i][8] == '=') {
+                sscanf(argv[i] + 9, "%u,%u,%u,%u,%u", &c.sprs, &c.emits, &c.texts, &c.frames,
+                       &c.texs);
+            }
+            stress_use(&c);
+        } else if (strncmp(argv[i], "--record=", 9) == 0) {
+            inp_use(INP_REC, argv[i] + 9);
+        } else if (strncmp(argv[i], "--replay=", 9) == 0) {
+            inp_use(INP_PLAY, argv[i] + 9);
+        } else if (strncmp(argv[i], "--res-budget=", 13) == 0) {
+            res_budget((u64)strtoull(argv[i] + 13, NULL, 10) * 1024, res_warn_top);
+        } else if (strncmp(argv[i], "--tex-budget=", 13) == 0) {
+            tex_budget((u64)strtoull(argv[i] + 13, NULL, 10) * 1024);
+        }
+    }
+    
     ini();
     run();
     fin();
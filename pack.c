@@ -0,0 +1,210 @@
+#include "eng.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Offline asset packer
+//   pack out.pak tex:NAME=file.bmp font:NAME=file.bmp:CW:CH:FIRST snd:NAME=file.wav
+// Textures and fonts are decoded with the engine loaders and stored in the
+// engine's in-memory layout so the runtime can use them straight from the map.
+
+#define MAX_ENTS 256
+
+static pak_ent ents[MAX_ENTS];
+static u32 nents;
+
+// Write a blob at the next aligned offset and record its index entry
+static int put(FILE* f, const char* name, u32 type, const void* data, u32 size,
+               u32 a, u32 b, u32 c, u32 d)
+{
+    if (nents == MAX_ENTS) {
+        fprintf(stderr, "Too many entries\n");
+        return 0;
+    }
+    
+    long off = ftell(f);
+    while (off % PAK_ALIGN) {
+        fputc(0, f);
+        off++;
+    }
+    
+    if (size && fwrite(data, 1, size, f) != size) {
+        fprintf(stderr, "Write failed: %s\n", name);
+        return 0;
+    }
+    
+    pak_ent* en = &ents[nents++];
+    memset(en, 0, sizeof(pak_ent));
+    strncpy(en->name, name, sizeof(en->name) - 1);
+    en->type = type;
+    en->off = (u32)off;
+    en->size = size;
+    en->a = a;
+    en->b = b;
+    en->c = c;
+    en->d = d;
+    printf("  %-15s type %u  %u bytes\n", en->name, type, size);
+    return 1;
+}
+
+static int put_tex(FILE* f, const char* name, const char* path)
+{
+    u32 id = tex_load(path);
+    tex* t = tex_get(id);
+    if (!t) return 0;
+    
+    int ok = put(f, name, RES_TEX, t->data, t->w * t->h * sizeof(col), t->w, t->h, 0, 0);
+    tex_free(id);
+    return ok;
+}
+
+static int put_font(FILE* f, const char* name, const char* args)
+{
+    char path[256];
+    unsigned cw, ch, first;
+    if (sscanf(args, "%255[^:]:%u:%u:%u", path, &cw, &ch, &first) != 4) {
+        fprintf(stderr, "Bad font spec: %s\n", args);
+        return 0;
+    }
+    
+    u32 id = font_load(path, cw, ch, first);
+    font* fn = font_get(id);
+    if (!fn) return 0;
+    
+    // Glyph bitmaps back to back
+    u32 gsz = fn->cw * fn->ch;
+    u8* glyphs = malloc(fn->num_chars * gsz);
+    if (!glyphs) {
+        font_free(id);
+        return 0;
+    }
+    for (u8 i = 0; i < fn->num_chars; i++) {
+        memcpy(glyphs + i * gsz, fn->chars[i].data, gsz);
+    }
+    
+    int ok = put(f, name, RES_FONT, glyphs, fn->num_chars * gsz,
+                 fn->cw, fn->ch, fn->first_char, fn->num_chars);
+    free(glyphs);
+    font_free(id);
+    return ok;
+}
+
+// Read a 16-bit PCM WAV file
+static int put_snd(FILE* f, const char* name, const char* path)
+{
+    FILE* w = fopen(path, "rb");
+    if (!w) {
+        fprintf(stderr, "Failed to open sound: %s\n", path);
+        return 0;
+    }
+    
+    u8 riff[12];
+    if (fread(riff, 1, 12, w) != 12 || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4)) {
+        fclose(w);
+        fprintf(stderr, "Not a WAV file: %s\n", path);
+        return 0;
+    }
+    
+    // Walk chunks until fmt and data are found
+    u16 fmt = 0, ch = 0, bits = 0;
+    u32 rate = 0;
+    u8 hdr[8];
+    while (fread(hdr, 1, 8, w) == 8) {
+        u32 sz;
+        memcpy(&sz, hdr + 4, 4);
+        
+        if (!memcmp(hdr, "fmt ", 4) && sz >= 16) {
+            u8 fb[16];
+            if (fread(fb, 1, 16, w) != 16) break;
+            memcpy(&fmt, fb, 2);
+            memcpy(&ch, fb + 2, 2);
+            memcpy(&rate, fb + 4, 4);
+            memcpy(&bits, fb + 14, 2);
+            fseek(w, sz - 16 + (sz & 1), SEEK_CUR);
+        } else if (!memcmp(hdr, "data", 4)) {
+            if (fmt != 1 || bits != 16 || !ch) {
+                fprintf(stderr, "Unsupported WAV format (must be 16-bit PCM): %s\n", path);
+                break;
+            }
+            u8* pcm = malloc(sz);
+            if (!pcm || fread(pcm, 1, sz, w) != sz) {
+                free(pcm);
+                fprintf(stderr, "Failed to read WAV data: %s\n", path);
+                break;
+            }
+            u32 len = sz / (2 * ch);
+            int ok = put(f, name, RES_SND, pcm, len * ch * 2, len, rate, ch, 0);
+            free(pcm);
+            fclose(w);
+            return ok;
+        } else {
+            fseek(w, sz + (sz & 1), SEEK_CUR);
+        }
+    }
+    
+    fclose(w);
+    fprintf(stderr, "No PCM data in WAV file: %s\n", path);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s out.pak tex:NAME=file.bmp font:NAME=file.bmp:CW:CH:FIRST snd:NAME=file.wav ...\n", argv[0]);
+        return 1;
+    }
+    
+    FILE* f = fopen(argv[1], "wb");
+    if (!f) {
+        fprintf(stderr, "Failed to create pack: %s\n", argv[1]);
+        return 1;
+    }
+    
+    // Header is rewritten once the index offset is known
+    pak_hdr hdr = {PAK_MAGIC, PAK_VER, 0, 0};
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    
+    int ok = 1;
+    for (int i = 2; i < argc && ok; i++) {
+        char kind[8], name[16];
+        int n = 0;
+        if (sscanf(argv[i], "%7[^:]:%15[^=]=%n", kind, name, &n) != 2 || !n) {
+            fprintf(stderr, "Bad entry: %s\n", argv[i]);
+            ok = 0;
+            break;
+        }
+        
+        const char* arg = argv[i] + n;
+        if (!strcmp(kind, "tex")) ok = put_tex(f, name, arg);
+        else if (!strcmp(kind, "font")) ok = put_font(f, name, arg);
+        else if (!strcmp(kind, "snd")) ok = put_snd(f, name, arg);
+        else {
+            fprintf(stderr, "Unknown entry kind: %s\n", kind);
+            ok = 0;
+        }
+    }
+    
+    if (ok) {
+        // Index table goes last
+        long off = ftell(f);
+        while (off % PAK_ALIGN) {
+            fputc(0, f);
+            off++;
+        }
+        hdr.n = nents;
+        hdr.idx_off = (u32)off;
+        ok = fwrite(ents, sizeof(pak_ent), nents, f) == nents &&
+             fseek(f, 0, SEEK_SET) == 0 &&
+             fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    }
+    
+    if (fclose(f) != 0) ok = 0;
+    res_clear();
+    
+    if (!ok) {
+        remove(argv[1]);
+        return 1;
+    }
+    printf("Wrote %s (%u entries)\n", argv[1], nents);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+#include "eng.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Replay determinism check
+//
+//   ./replay_check [path/to/eng]
+//
+// Records a scripted session (menu, game with jumps and steering, pause,
+// back to the menu) as an input file, replays it twice through the engine
+// and compares the RNG checks both runs print. Exits non-zero when they
+// differ, i.e. when something other than the recorded input steered a run
+
+// One stretch of frames with the same keys held
+typedef struct {
+    u32 frames;
+    u16 keys;
+} chk_step;
+
+#define K(k) ((u16)1 << (k))
+
+static const chk_step chk_script[] = {
+    {10, 0},
+    {3, K(KEY_SPACE)},          // menu: start the game
+    {20, 0},
+    {3, K(KEY_SPACE)},          // jump
+    {40, K(KEY_LEFT)},
+    {3, K(KEY_SPACE) | K(KEY_RIGHT)},
+    {40, K(KEY_RIGHT)},
+    {20, 0},
+    {3, K(KEY_ESC)},            // pause
+    {5, 0},
+    {3, K(KEY_2)},              // back to the menu
+    {30, 0},
+};
+
+// Write the script in the recorder's format
+static int chk_write(const char* path)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+
+    inp_hdr h = {INP_MAGIC, 1, 0, 16, 1};
+    for (u32 i = 0; i < sizeof(chk_script) / sizeof(chk_script[0]); i++) {
+        h.frames += chk_script[i].frames;
+    }
+    fwrite(&h, sizeof(h), 1, f);
+
+    u16 last = 0;
+    for (u32 i = 0; i < sizeof(chk_script) / sizeof(chk_script[0]); i++) {
+        for (u32 k = 0; k < chk_script[i].frames; k++) {
+            u16 keys = chk_script[i].keys;
+            fputc(keys != last ? INP_KEYS : 0, f);
+            if (keys != last) fwrite(&keys, sizeof(keys), 1, f);
+            last = keys;
+        }
+    }
+    return fclose(f) == 0;
+}
+
+// Replay path and return the engine's check line, empty if none
+static int chk_run(const char* eng, const char* path, char* out, size_t sz)
+{
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "%s --audio=null --replay=%s", eng, path);
+    FILE* p = popen(cmd, "r");
+    if (!p) return 0;
+
+    char line[256];
+    out[0] = 0;
+    while (fgets(line, sizeof(line), p)) {
+        if (!strncmp(line, "Input replay check:", 19)) snprintf(out, sz, "%s", line);
+    }
+    return pclose(p) == 0 && out[0];
+}
+
+int main(int argc, char** argv)
+{
+    const char* eng = argc > 1 ? argv[1] : "./eng";
+    char path[64], a[256], b[256];
+    snprintf(path, sizeof(path), "/tmp/replay_check_%u.ginp", (u32)getpid());
+
+    if (!chk_write(path)) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return 1;
+    }
+    int ok = chk_run(eng, path, a, sizeof(a)) && chk_run(eng, path, b, sizeof(b));
+    remove(path);
+    if (!ok) {
+        fprintf(stderr, "Replay failed: %s\n", eng);
+        return 1;
+    }
+
+    printf("run 1: %srun 2: %s", a, b);
+    if (strcmp(a, b)) {
+        printf("FAIL: replays diverged\n");
+        return 1;
+    }
+    printf("OK: replays match\n");
+    return 0;
+}